@@ -0,0 +1,557 @@
+#include "include/graphic.h"
+#include "include/map.h"
+#include "include/render.h"
+#include "include/thread_pool.h"
+#include "include/raycast.h"
+#include "include/spatial.h"
+#include "include/world.h"
+#include "include/scheduler.h"
+#include "include/profile.h"
+#include "include/replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Headless frame benchmark. Replays a camera path over demo.map and a few
+// generated maps and reports how long each render pass takes. Run it from
+// the build directory so the map and textures resolve like the game does.
+
+static Map map;
+static World* world = NULL;
+static RenderView* view = NULL;
+
+enum BENCH_STAGES {
+    STAGE_SIM,
+    STAGE_WALLS,
+    STAGE_FLOOR,
+    STAGE_ENTITIES,
+    STAGE_UI,
+    STAGE_WEAPON,
+    STAGE_POSTFX,
+    STAGE_COUNT
+};
+
+static const char* stage_names[STAGE_COUNT] = {
+    "sim", "walls", "floor", "entities", "ui", "weapon", "postfx"
+};
+
+typedef Camera CameraPose;
+
+static CameraPose* camera_path = NULL;
+static int camera_path_length = 0;
+
+static uint32_t bench_seed = 12345;
+
+static uint32_t bench_rand() {
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return bench_seed >> 8;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static CameraPose pose_from_angle(float x, float y, float angle) {
+    CameraPose pose;
+    pose.posX = x;
+    pose.posY = y;
+    pose.dirX = cosf(angle);
+    pose.dirY = sinf(angle);
+    pose.planeX = -pose.dirY * 0.66f;
+    pose.planeY = pose.dirX * 0.66f;
+    return pose;
+}
+
+// Orbit around the map centre, looking mostly along the path but swinging
+// across it so both short and long rays are exercised.
+static CameraPose orbit_pose(int frame, int frames) {
+    float t = frame * 2.0f * (float)M_PI / frames;
+    float radius = fminf(map.height, map.width) * 0.3f;
+    float x = map.height * 0.5f + cosf(t) * radius;
+    float y = map.width * 0.5f + sinf(t) * radius;
+    return pose_from_angle(x, y, t + (float)M_PI / 2 + 0.8f * sinf(3 * t));
+}
+
+static CameraPose path_pose(int frame, int frames) {
+    if(camera_path_length > 0) return camera_path[frame % camera_path_length];
+    return orbit_pose(frame, frames);
+}
+
+// Path file: one pose per line, "posX posY dirX dirY planeX planeY"
+static int load_camera_path(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if(!file) return 0;
+
+    char line[256];
+    int capacity = 0;
+    while(fgets(line, sizeof(line), file)) {
+        CameraPose pose;
+        if(sscanf(line, "%f %f %f %f %f %f", &pose.posX, &pose.posY,
+                  &pose.dirX, &pose.dirY, &pose.planeX, &pose.planeY) != 6) continue;
+        if(camera_path_length == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            camera_path = realloc(camera_path, capacity * sizeof(CameraPose));
+        }
+        camera_path[camera_path_length++] = pose;
+    }
+
+    fclose(file);
+    return camera_path_length > 0;
+}
+
+// Border walls plus pillars scattered at `density` per thousand cells, with
+// the camera orbit kept clear
+static void generate_map(int size, int density, int frames) {
+    alloc_map(&map, size, size);
+    for(int x = 0; x < map.height; x++) {
+        for(int y = 0; y < map.width; y++) {
+            int border = x == 0 || y == 0 || x == map.height - 1 || y == map.width - 1;
+            map_set(&map, x, y, border || (int)(bench_rand() % 1000) < density);
+        }
+    }
+
+    for(int i = 0; i < frames; i++) {
+        CameraPose pose = orbit_pose(i, frames);
+        for(int x = (int)pose.posX - 1; x <= (int)pose.posX + 1; x++) {
+            for(int y = (int)pose.posY - 1; y <= (int)pose.posY + 1; y++) {
+                if(x > 0 && y > 0 && x < map.height - 1 && y < map.width - 1) {
+                    map_set(&map, x, y, 0);
+                }
+            }
+        }
+    }
+    map_build_distance(&map);
+}
+
+static void spawn_entities(World* target, int count) {
+    EntityStore* entities = &target->entities;
+    entity_clear(entities);
+    world_seed(target, bench_rand());
+    for(int tries = 0; entities->count < count && tries < count * 100; tries++) {
+        int x = 1 + bench_rand() % (map.height - 2);
+        int y = 1 + bench_rand() % (map.width - 2);
+        if(map_is_solid(&map, x, y)) continue;
+
+        // Alternate pickups and wanderers, with every eighth wanderer chasing
+        int pickup = entities->count % 2;
+        float angle = (bench_rand() % 360) * ((float)M_PI / 180.0f);
+        entity_spawn(entities, (Entity){
+            .x = x + 0.5f,
+            .y = y + 0.5f,
+            .dx = pickup ? 0.0f : cosf(angle) * 0.02f,
+            .dy = pickup ? 0.0f : sinf(angle) * 0.02f,
+            .move_timer = 1.0f + (bench_rand() % 100) / 20.0f,
+            .texture_id = pickup ? TEX_AMMO : TEX_ENTITY,
+            .visible = 1,
+            .is_chaser = entities->count % 16 == 14,
+            .is_static = pickup
+        });
+    }
+}
+
+static int write_ppm(const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if(!file) return 0;
+
+    const Surface* frame = render_target(view);
+    fprintf(file, "P6\n%d %d\n255\n", frame->width, frame->height);
+    for(int i = 0; i < frame->width * frame->height; i++) {
+        uint8_t rgb[3] = {
+            (frame->pixels[i] >> 16) & 0xFF,
+            (frame->pixels[i] >> 8) & 0xFF,
+            frame->pixels[i] & 0xFF
+        };
+        fwrite(rgb, 1, 3, file);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static uint32_t hash_frame(const RenderView* source, uint32_t hash) {
+    const Surface* frame = render_target(source);
+    for(int i = 0; i < frame->width * frame->height; i++) {
+        hash = (hash ^ frame->pixels[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static const char* screenshot_file = NULL;
+
+static void run_bench(const char* name, int frames) {
+    uint64_t stage_ns[STAGE_COUNT] = {0};
+    uint64_t counters[COUNTER_COUNT] = {0};
+    uint32_t checksum = 2166136261u;
+    int warmup = frames / 10;
+
+    for(int frame = -warmup; frame < frames; frame++) {
+        world->camera = path_pose(frame < 0 ? frame + warmup : frame, frames);
+        render_set_camera(view, world->camera);
+
+        // Keep the pickup flash on so the post-FX pass is always measured
+        world->ui.pickup_flash_timer = 1.0f;
+
+        uint64_t t[STAGE_COUNT + 1];
+        t[0] = now_ns();
+        entity_update(world, 1.0f / 60.0f);
+        t[1] = now_ns();
+        render_walls(view, world);
+        t[2] = now_ns();
+        render_floor(view);
+        t[3] = now_ns();
+        render_entities(view, world);
+        t[4] = now_ns();
+        render_ui(view, world);
+        t[5] = now_ns();
+        render_weapon(view, world);
+        t[6] = now_ns();
+        render_postfx(view, world);
+        t[7] = now_ns();
+
+        profile_frame_end();
+        if(frame < 0) continue;
+        for(int i = 0; i < STAGE_COUNT; i++) stage_ns[i] += t[i + 1] - t[i];
+        for(int i = 0; i < COUNTER_COUNT; i++) counters[i] += profile_frame_counter(i);
+        checksum = hash_frame(view, checksum);
+    }
+
+    // Only the first map run is saved
+    if(screenshot_file) {
+        if(!write_ppm(screenshot_file)) fprintf(stderr, "Failed to write %s\n", screenshot_file);
+        screenshot_file = NULL;
+    }
+
+    uint64_t total = 0;
+    printf("%-14s %5dx%-5d", name, map.height, map.width);
+    for(int i = 0; i < STAGE_COUNT; i++) {
+        printf(" %9llu", (unsigned long long)(stage_ns[i] / frames));
+        total += stage_ns[i];
+    }
+    double ns_per_frame = (double)total / frames;
+    printf(" %10.0f %9.1f  %08x\n", ns_per_frame, 1e9 / ns_per_frame, checksum);
+#ifdef PROFILE
+    const Surface* target = render_target(view);
+    printf("%-14s %11s %9llu dda steps, %9llu pixels, %.2fx sprite overdraw, %llu sorted per frame\n", "", "",
+           (unsigned long long)(counters[COUNTER_DDA_STEPS] / frames),
+           (unsigned long long)(counters[COUNTER_PIXELS] / frames),
+           (double)counters[COUNTER_SPRITE_PIXELS] / frames / (target->width * target->height),
+           (unsigned long long)(counters[COUNTER_SORTED] / frames));
+#endif
+}
+
+// View settings from the command line, applied to every view created
+static float fog_distance = 0.0f;
+static float gamma_setting = 1.0f;
+static int column_step = 1;
+
+static RenderView* create_view(int width, int height) {
+    RenderView* created = render_view_create(width, height);
+    if(!created) return NULL;
+    if(fog_distance > 0.0f) {
+        render_set_fog(created, 0x000000, fog_distance * 0.25f, fog_distance);
+        render_set_fog_culling(created, 1);
+        render_set_side_light(created, 0.75f);
+    }
+    render_set_gamma(created, gamma_setting);
+    render_set_column_step(created, column_step);
+    return created;
+}
+
+// Many small simulations at once: `count` worlds on the current map, each
+// walking its own circle from a different point of the camera orbit and
+// drawn by its own view, stepped together through the scheduler
+static int run_instances(const char* name, int frames, int count, int entity_target) {
+    Instance* instances = calloc(count, sizeof(Instance));
+    if(!instances) return 0;
+    const Surface* frame = render_target(view);
+    int ok = 1;
+    for(int i = 0; i < count && ok; i++) {
+        instances[i].world = world_create(&map);
+        instances[i].view = create_view(frame->width, frame->height);
+        instances[i].input = INPUT_FORWARD | (i % 2 ? INPUT_TURN_LEFT : INPUT_TURN_RIGHT);
+        ok = instances[i].world && instances[i].view;
+        if(!ok) break;
+        instances[i].world->camera = orbit_pose(i * frames / count, frames);
+        spawn_entities(instances[i].world, entity_target);
+    }
+
+    if(ok) {
+        int warmup = frames / 10;
+        for(int step = 0; step < warmup; step++) scheduler_step(instances, count);
+        uint64_t start = now_ns();
+        for(int step = 0; step < frames; step++) scheduler_step(instances, count);
+        double ns_per_step = (double)(now_ns() - start) / frames;
+        printf("%-14s %5dx%-5d %9d instances %10.0f ns/step %9.1f frames/s\n",
+               name, map.height, map.width, count, ns_per_step, count * 1e9 / ns_per_step);
+    }
+
+    for(int i = 0; i < count; i++) {
+        world_destroy(instances[i].world);
+        render_view_destroy(instances[i].view);
+    }
+    free(instances);
+    return ok;
+}
+
+// `count` poses spread around the camera orbit, all against the bench
+// world, drawn per frame as one batch into buffers owned here
+static int run_batch(const char* name, int frames, int count, int flags) {
+    RenderBatch* batch = render_batch_create(view, flags);
+    RenderBatchEntry* entries = calloc(count, sizeof(RenderBatchEntry));
+    int width, height;
+    if(!batch || !entries) {
+        render_batch_destroy(batch);
+        free(entries);
+        return 0;
+    }
+    render_batch_size(batch, &width, &height);
+    int bytes_per_pixel = flags & RENDER_BATCH_GRAY ? 1 : 4;
+    uint8_t* buffers = malloc((size_t)count * width * height * bytes_per_pixel);
+    for(int i = 0; i < count && buffers; i++) {
+        entries[i].world = world;
+        entries[i].pixels = buffers + (size_t)i * width * height * bytes_per_pixel;
+    }
+
+    uint32_t checksum = 2166136261u;
+    uint64_t elapsed = 0;
+    int warmup = frames / 10;
+    for(int frame = -warmup; frame < frames && buffers; frame++) {
+        int at = frame < 0 ? frame + warmup : frame;
+        for(int i = 0; i < count; i++) entries[i].camera = orbit_pose(at + i * frames / count, frames);
+
+        uint64_t start = now_ns();
+        render_batch(batch, entries, count);
+        if(frame < 0) continue;
+        elapsed += now_ns() - start;
+        for(size_t i = 0; i < (size_t)count * width * height * bytes_per_pixel; i++) {
+            checksum = (checksum ^ buffers[i]) * 16777619u;
+        }
+    }
+
+    if(buffers) {
+        double ns_per_batch = (double)elapsed / frames;
+        printf("%-14s %5dx%-5d %9d views    %10.0f ns/batch %8.1f frames/s  %08x\n",
+               name, map.height, map.width, count, ns_per_batch, count * 1e9 / ns_per_batch, checksum);
+    }
+    free(buffers);
+    free(entries);
+    render_batch_destroy(batch);
+    return buffers != NULL;
+}
+
+// Plays a recorded session back headless, one frame per tick with no
+// waiting, and reports how much faster than real time it ran. The checksum
+// covers every frame, so two runs drawing the same session match exactly;
+// `hash_file` gets each frame's own hash, one line per tick, to find the
+// first frame that differs.
+static int run_replay(const char* replay_file, const char* hash_file) {
+    Replay replay;
+    if(!replay_load(&replay, replay_file)) {
+        fprintf(stderr, "Failed to load replay %s!\n", replay_file);
+        return 0;
+    }
+    FILE* hashes = hash_file ? fopen(hash_file, "w") : NULL;
+    World* session = NULL;
+    int ok = (!hash_file || hashes) && load_map(&map, replay.map_file) && (session = world_create(&map));
+    if(!ok) {
+        fprintf(stderr, "Failed to start the replay!\n");
+    } else {
+        world_seed(session, replay.seed);
+        world_spawn_entities(session);
+
+        uint32_t checksum = 2166136261u;
+        uint64_t start = now_ns();
+        for(int tick = 0; tick < replay.tick_count; tick++) {
+            world_tick(session, replay.inputs[tick]);
+            render_set_camera(view, session->camera);
+            render_scene(view, session);
+            profile_frame_end();
+            checksum = hash_frame(view, checksum);
+            if(hashes) fprintf(hashes, "%d %08x\n", tick, hash_frame(view, 2166136261u));
+        }
+        double seconds = (now_ns() - start) / 1e9;
+        double recorded = replay.tick_count * TICK_SECONDS;
+        printf("%-14s %5dx%-5d %9d ticks %10.0f ns/tick %8.1fx real time  %08x\n",
+               replay.map_file, map.height, map.width, replay.tick_count,
+               replay.tick_count ? seconds * 1e9 / replay.tick_count : 0.0,
+               seconds > 0.0 ? recorded / seconds : 0.0, checksum);
+    }
+    if(hashes && fclose(hashes) != 0) ok = 0;
+    world_destroy(session);
+    replay_free(&replay);
+    return ok;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "usage: %s [-f frames] [-e entities] [-t threads] [-s isa] [-k] [-r WxH] [-c step] [-g gamma] [-F distance] [-i instances] [-b views] [-y] [-T trace.json] [-R in.rec [-H hashes.txt]] [-m map] [-p path] [-o out.ppm]\n"
+        "  -f  frames rendered per map (default 600)\n"
+        "  -e  entities spawned per map (default 64)\n"
+        "  -t  render threads, 0 for one per CPU (default 1)\n"
+        "  -s  ray traversal: scalar, sse or avx2 (default: best supported)\n"
+        "  -k  step every cell instead of skipping empty space\n"
+        "  -r  internal resolution (default 320x240)\n"
+        "  -c  screen columns per wall ray, 1 to 4 (default 1)\n"
+        "  -g  output gamma, adding a lookup pass to post-FX (default 1)\n"
+        "  -F  fog, side shading and ray culling, solid fog at this many cells\n"
+        "  -i  also step this many worlds at once, each ticking and drawing its\n"
+        "      own frame, and report the combined frame rate\n"
+        "  -b  also draw this many poses per frame as one render_batch()\n"
+        "  -y  batches draw grayscale\n"
+        "  -T  write a Chrome trace of the run (PROFILE=1 builds)\n"
+        "  -R  only play back a session recorded by main -R, as fast as it renders\n"
+        "  -H  with -R, write each frame's hash per tick, for diffing two runs\n"
+        "  -m  benchmark a single .map file instead of the default set\n"
+        "  -p  camera path file, one \"posX posY dirX dirY planeX planeY\" per line\n"
+        "  -o  save the last frame of the first map as a PPM image\n",
+        argv0);
+}
+
+int main(int argc, char* argv[]) {
+    int frames = 600;
+    int entity_target = 64;
+    int threads = 1;
+    const char* map_file = NULL;
+    int instance_count = 0;
+    int batch_count = 0, batch_flags = 0;
+    const char* trace_file = NULL;
+    const char* replay_file = NULL;
+    const char* hash_file = NULL;
+    int width = DEFAULT_SCREEN_WIDTH, height = DEFAULT_SCREEN_HEIGHT;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            entity_target = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            const char* isa = argv[++i];
+            if(strcmp(isa, "scalar") == 0) raycast_set_isa(RAY_ISA_SCALAR);
+            else if(strcmp(isa, "sse") == 0) raycast_set_isa(RAY_ISA_SSE);
+            else raycast_set_isa(RAY_ISA_AVX2);
+        } else if(strcmp(argv[i], "-k") == 0) {
+            raycast_set_skip(0);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if(sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            fog_distance = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            gamma_setting = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            column_step = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            instance_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-y") == 0) {
+            batch_flags |= RENDER_BATCH_GRAY;
+        } else if(strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if(strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if(strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            hash_file = argv[++i];
+        } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            screenshot_file = argv[++i];
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if(!load_camera_path(argv[++i])) {
+                fprintf(stderr, "Failed to load camera path!\n");
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(frames <= 0) frames = 1;
+    view = create_view(width, height);
+    world = world_create(&map);
+    if(!view || !world) {
+        fprintf(stderr, "Failed to allocate the framebuffer!\n");
+        return 1;
+    }
+    const Surface* frame = render_target(view);
+
+    if (texture_load("texture/wall.bmp") != TEX_WALL ||
+        texture_load("texture/entity.bmp") != TEX_ENTITY ||
+        texture_load("texture/weapon.bmp") != TEX_WEAPON ||
+        texture_load("texture/ammo.bmp") != TEX_AMMO) {
+        fprintf(stderr, "Failed to load textures!\n");
+        return 1;
+    }
+    texture_build_atlas();
+
+    threads = thread_pool_init(threads);
+    if(replay_file) {
+        printf("replay at %dx%d, %d threads, %s rays, %d columns per ray\n",
+               frame->width, frame->height, threads,
+               raycast_isa_name(raycast_isa()), render_column_step(view));
+    } else {
+        printf("%d frames at %dx%d, %d entities, %d threads, %s rays, %d columns per ray\n",
+               frames, frame->width, frame->height, entity_target, threads,
+               raycast_isa_name(raycast_isa()), render_column_step(view));
+        printf("%-14s %11s", "map", "size");
+        for(int i = 0; i < STAGE_COUNT; i++) printf(" %9s", stage_names[i]);
+        printf(" %10s %9s  %s\n", "ns/frame", "fps", "checksum");
+    }
+
+    if(replay_file) {
+        if(!run_replay(replay_file, hash_file)) return 1;
+    } else if(map_file) {
+        if(!load_map(&map, map_file)) {
+            fprintf(stderr, "Failed to load map!\n");
+            return 1;
+        }
+        spawn_entities(world, entity_target);
+        run_bench(map_file, frames);
+        if(instance_count > 0) run_instances(map_file, frames, instance_count, entity_target);
+        if(batch_count > 0) run_batch(map_file, frames, batch_count, batch_flags);
+    } else {
+        // Dense maps, then a mostly open one
+        static const struct { int size, density; const char* name; } generated[] = {
+            {64, 30, "generated"},
+            {256, 30, "generated"},
+            {1024, 30, "generated"},
+            {1024, 1, "open"},
+        };
+
+        if(!load_map(&map, "demo.map")) {
+            fprintf(stderr, "Failed to load map!\n");
+            return 1;
+        }
+        spawn_entities(world, entity_target);
+        run_bench("demo.map", frames);
+        if(instance_count > 0) run_instances("demo.map", frames, instance_count, entity_target);
+        if(batch_count > 0) run_batch("demo.map", frames, batch_count, batch_flags);
+
+        for(int i = 0; i < (int)(sizeof(generated) / sizeof(generated[0])); i++) {
+            bench_seed = 12345 + generated[i].size + generated[i].density;
+            generate_map(generated[i].size, generated[i].density, frames);
+            spawn_entities(world, entity_target);
+            run_bench(generated[i].name, frames);
+            if(instance_count > 0) run_instances(generated[i].name, frames, instance_count, entity_target);
+            if(batch_count > 0) run_batch(generated[i].name, frames, batch_count, batch_flags);
+        }
+    }
+
+    if(trace_file && !profile_write_trace(trace_file)) fprintf(stderr, "Failed to write %s\n", trace_file);
+
+    texture_free_all();
+    render_view_destroy(view);
+    world_destroy(world);
+    free(camera_path);
+    free_map(&map);
+    thread_pool_shutdown();
+    return 0;
+}
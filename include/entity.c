@@ -0,0 +1,340 @@
+#include "entity.h"
+#include "map.h"
+#include "thread_pool.h"
+#include "spatial.h"
+#include "world.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENTITY_X86 1
+#include <immintrin.h>
+#endif
+
+// Batches handed to each thread pool tile
+#define ENTITY_UPDATE_GRAIN 256
+
+static int grow_array(void** array, int element_size, int capacity) {
+    void* grown = realloc(*array, (size_t)capacity * element_size);
+    if(!grown) return 0;
+    *array = grown;
+    return 1;
+}
+
+static int grow_store(EntityStore* entities) {
+    int capacity = entities->capacity ? entities->capacity * 2 : 64;
+    if(capacity > (int)ENTITY_INDEX_MASK + 1) return 0;
+
+    if(!grow_array((void**)&entities->x, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->y, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->dx, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->dy, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->move_timer, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->prev_x, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->prev_y, sizeof(float), capacity) ||
+       !grow_array((void**)&entities->texture_id, sizeof(int32_t), capacity) ||
+       !grow_array((void**)&entities->flags, sizeof(uint8_t), capacity) ||
+       !grow_array((void**)&entities->generations, sizeof(uint8_t), capacity) ||
+       !grow_array((void**)&entities->free_slots, sizeof(int), capacity)) {
+        return 0;
+    }
+
+    // Padding lanes read as dead so batches never touch them
+    memset(entities->flags + entities->capacity, 0, capacity - entities->capacity);
+    memset(entities->generations + entities->capacity, 0, capacity - entities->capacity);
+    entities->capacity = capacity;
+    return 1;
+}
+
+// Versions come from one process-wide counter, so no two stores, or one
+// store before and after a clear, ever share one
+static unsigned store_versions = 0;
+
+static void bump_version(EntityStore* entities) {
+    entities->version = __atomic_add_fetch(&store_versions, 1, __ATOMIC_RELAXED);
+}
+
+EntityHandle entity_spawn(EntityStore* entities, Entity e) {
+    int index;
+    if(entities->free_count > 0) {
+        index = entities->free_slots[--entities->free_count];
+    } else {
+        if(entities->count == entities->capacity && !grow_store(entities)) return ENTITY_NONE;
+        index = entities->count++;
+    }
+
+    entities->x[index] = e.x;
+    entities->y[index] = e.y;
+    entities->dx[index] = e.dx;
+    entities->dy[index] = e.dy;
+    entities->move_timer[index] = e.move_timer;
+    entities->prev_x[index] = e.x;
+    entities->prev_y[index] = e.y;
+    entities->texture_id[index] = e.texture_id;
+    entities->flags[index] = ENTITY_ALIVE |
+        (e.visible ? ENTITY_VISIBLE : 0) |
+        (e.is_chaser ? ENTITY_CHASER : 0) |
+        (e.is_static ? ENTITY_STATIC : 0);
+    bump_version(entities);
+    return entity_handle(entities, index);
+}
+
+void entity_despawn(EntityStore* entities, EntityHandle handle) {
+    int index = entity_index(entities, handle);
+    if(index < 0) return;
+
+    entities->flags[index] = 0;
+    entities->generations[index]++;
+    entities->free_slots[entities->free_count++] = index;
+    bump_version(entities);
+}
+
+int entity_index(const EntityStore* entities, EntityHandle handle) {
+    int index = handle & ENTITY_INDEX_MASK;
+    if(handle == ENTITY_NONE || index >= entities->count) return -1;
+    if(entities->generations[index] != handle >> ENTITY_INDEX_BITS || !entity_alive(entities, index)) return -1;
+    return index;
+}
+
+EntityHandle entity_handle(const EntityStore* entities, int index) {
+    return ((EntityHandle)entities->generations[index] << ENTITY_INDEX_BITS) | (EntityHandle)index;
+}
+
+void entity_clear(EntityStore* entities) {
+    for(int i = 0; i < entities->count; i++) entities->generations[i]++;
+    if(entities->capacity) memset(entities->flags, 0, entities->capacity);
+    entities->count = 0;
+    entities->free_count = 0;
+    bump_version(entities);
+}
+
+void entity_store_free(EntityStore* entities) {
+    free(entities->x);
+    free(entities->y);
+    free(entities->dx);
+    free(entities->dy);
+    free(entities->move_timer);
+    free(entities->prev_x);
+    free(entities->prev_y);
+    free(entities->texture_id);
+    free(entities->flags);
+    free(entities->generations);
+    free(entities->free_slots);
+    memset(entities, 0, sizeof(*entities));
+}
+
+void entity_randomize_direction(World* world, int i) {
+    EntityStore* entities = &world->entities;
+    float angle = (world_random(world) % 360) * (M_PI / 180.0f);
+    float speed = 0.02f; // Adjust movement speed
+    entities->dx[i] = cos(angle) * speed;
+    entities->dy[i] = sin(angle) * speed;
+    entities->move_timer[i] = (world_random(world) % 100) / 20.0f + 1.0f; // 1-6 seconds
+}
+
+// What the update kernels read besides the store
+typedef struct {
+    EntityStore* entities;
+    const Map* map;
+    float posX, posY;   // the player, for chasers
+    int avx2;           // batches take the AVX2 path
+} UpdateJob;
+
+static void move_entity(const UpdateJob* job, int i) {
+    EntityStore* entities = job->entities;
+    const Map* map = job->map;
+    float new_x = entities->x[i] + entities->dx[i];
+    float new_y = entities->y[i] + entities->dy[i];
+
+    // Check X movement
+    if(!map_is_solid(map, (int)new_x, (int)entities->y[i])) {
+        entities->x[i] = new_x;
+    } else {
+        entities->dx[i] *= -1; // Bounce off wall
+    }
+
+    // Check Y movement
+    if(!map_is_solid(map, (int)entities->x[i], (int)new_y)) {
+        entities->y[i] = new_y;
+    } else {
+        entities->dy[i] *= -1; // Bounce off wall
+    }
+}
+
+static void chase_player(const UpdateJob* job, int i) {
+    EntityStore* entities = job->entities;
+    const Map* map = job->map;
+    float chase_speed = 0.03f;
+    float dx = job->posX - entities->x[i];
+    float dy = job->posY - entities->y[i];
+    float dist = sqrtf(dx*dx + dy*dy);
+
+    if(dist > 1.5f) { // Stop when close
+        // Normalize direction
+        float inv_dist = 1.0f / dist;
+        entities->dx[i] = dx * inv_dist * chase_speed;
+        entities->dy[i] = dy * inv_dist * chase_speed;
+
+        // Move with collision check
+        float new_x = entities->x[i] + entities->dx[i];
+        float new_y = entities->y[i] + entities->dy[i];
+
+        if(!map_is_solid(map, (int)new_x, (int)entities->y[i])) entities->x[i] = new_x;
+        if(!map_is_solid(map, (int)entities->x[i], (int)new_y)) entities->y[i] = new_y;
+    }
+}
+
+static void update_batch_scalar(const UpdateJob* job, int first) {
+    EntityStore* entities = job->entities;
+    float max_x = job->map->height - 1.1f;
+    float max_y = job->map->width - 1.1f;
+
+    for(int i = first; i < first + ENTITY_BATCH; i++) {
+        if((entities->flags[i] & (ENTITY_ALIVE | ENTITY_STATIC)) != ENTITY_ALIVE) continue;
+
+        if(entities->flags[i] & ENTITY_CHASER) chase_player(job, i);
+        else move_entity(job, i);
+
+        // Keep within bounds (for moving entities only)
+        entities->x[i] = fmaxf(1.1f, fminf(max_x, entities->x[i]));
+        entities->y[i] = fmaxf(1.1f, fminf(max_y, entities->y[i]));
+    }
+}
+
+#ifdef ENTITY_X86
+// map_is_solid(map, ) for eight cells, only looked up in the lanes set in `mask`
+__attribute__((target("avx2")))
+static __m256i solid_avx2(const MapGrid* grid, __m256i x, __m256i y, __m256i mask) {
+    __m256i cell_mask = _mm256_set1_epi32(MAP_TILE_SIZE - 1);
+    __m256i tile = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_srli_epi32(x, MAP_TILE_SHIFT), _mm256_set1_epi32(grid->tiles_y)),
+        _mm256_srli_epi32(y, MAP_TILE_SHIFT));
+    __m256i bit = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(x, cell_mask), MAP_TILE_SHIFT),
+        _mm256_and_si256(y, cell_mask));
+    __m256i word = _mm256_add_epi32(_mm256_slli_epi32(tile, 1), _mm256_srli_epi32(bit, 5));
+    __m256i bits = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+        (const int*)grid->solid, word, mask, 4);
+    __m256i solid = _mm256_and_si256(
+        _mm256_srlv_epi32(bits, _mm256_and_si256(bit, _mm256_set1_epi32(31))),
+        _mm256_set1_epi32(1));
+    return _mm256_and_si256(mask, _mm256_cmpeq_epi32(solid, _mm256_set1_epi32(1)));
+}
+
+// update_batch_scalar() for eight entities at once, written as masked
+// selects over the same float operations
+__attribute__((target("avx2")))
+static void update_batch_avx2(const UpdateJob* job, int first) {
+    EntityStore* entities = job->entities;
+    const MapGrid* grid = &job->map->grid;
+    __m256 x = _mm256_loadu_ps(entities->x + first);
+    __m256 y = _mm256_loadu_ps(entities->y + first);
+    __m256 dx = _mm256_loadu_ps(entities->dx + first);
+    __m256 dy = _mm256_loadu_ps(entities->dy + first);
+    __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(entities->flags + first)));
+
+    __m256i moving = _mm256_cmpeq_epi32(
+        _mm256_and_si256(flags, _mm256_set1_epi32(ENTITY_ALIVE | ENTITY_STATIC)),
+        _mm256_set1_epi32(ENTITY_ALIVE));
+    if(_mm256_testz_si256(moving, moving)) return;
+    __m256i chaser = _mm256_andnot_si256(
+        _mm256_cmpeq_epi32(_mm256_and_si256(flags, _mm256_set1_epi32(ENTITY_CHASER)), _mm256_setzero_si256()),
+        moving);
+
+    // Chasers close enough to the player stand still
+    __m256 toX = _mm256_sub_ps(_mm256_set1_ps(job->posX), x);
+    __m256 toY = _mm256_sub_ps(_mm256_set1_ps(job->posY), y);
+    __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(toX, toX), _mm256_mul_ps(toY, toY)));
+    __m256i chase = _mm256_and_si256(chaser,
+        _mm256_castps_si256(_mm256_cmp_ps(dist, _mm256_set1_ps(1.5f), _CMP_GT_OQ)));
+    __m256 inv_dist = _mm256_div_ps(_mm256_set1_ps(1.0f), dist);
+    __m256 speed = _mm256_set1_ps(0.03f);
+    dx = _mm256_blendv_ps(dx, _mm256_mul_ps(_mm256_mul_ps(toX, inv_dist), speed), _mm256_castsi256_ps(chase));
+    dy = _mm256_blendv_ps(dy, _mm256_mul_ps(_mm256_mul_ps(toY, inv_dist), speed), _mm256_castsi256_ps(chase));
+
+    __m256i stepping = _mm256_or_si256(_mm256_andnot_si256(chaser, moving), chase);
+    __m256i wander = _mm256_andnot_si256(chaser, stepping);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 new_x = _mm256_add_ps(x, dx);
+    __m256 new_y = _mm256_add_ps(y, dy);
+
+    __m256i blockedX = solid_avx2(grid, _mm256_cvttps_epi32(new_x), _mm256_cvttps_epi32(y), stepping);
+    x = _mm256_blendv_ps(x, new_x, _mm256_castsi256_ps(_mm256_andnot_si256(blockedX, stepping)));
+    dx = _mm256_blendv_ps(dx, _mm256_xor_ps(dx, sign), _mm256_castsi256_ps(_mm256_and_si256(blockedX, wander)));
+
+    __m256i blockedY = solid_avx2(grid, _mm256_cvttps_epi32(x), _mm256_cvttps_epi32(new_y), stepping);
+    y = _mm256_blendv_ps(y, new_y, _mm256_castsi256_ps(_mm256_andnot_si256(blockedY, stepping)));
+    dy = _mm256_blendv_ps(dy, _mm256_xor_ps(dy, sign), _mm256_castsi256_ps(_mm256_and_si256(blockedY, wander)));
+
+    __m256 clamped_x = _mm256_max_ps(_mm256_set1_ps(1.1f), _mm256_min_ps(_mm256_set1_ps(job->map->height - 1.1f), x));
+    __m256 clamped_y = _mm256_max_ps(_mm256_set1_ps(1.1f), _mm256_min_ps(_mm256_set1_ps(job->map->width - 1.1f), y));
+    x = _mm256_blendv_ps(x, clamped_x, _mm256_castsi256_ps(moving));
+    y = _mm256_blendv_ps(y, clamped_y, _mm256_castsi256_ps(moving));
+
+    _mm256_storeu_ps(entities->x + first, x);
+    _mm256_storeu_ps(entities->y + first, y);
+    _mm256_storeu_ps(entities->dx + first, dx);
+    _mm256_storeu_ps(entities->dy + first, dy);
+}
+#endif
+
+// Detected on first use by whichever thread gets there; every thread
+// finds the same value, so racing stores are harmless once atomic
+static int use_avx2 = -1;
+
+static int entity_use_avx2() {
+    int avx2 = __atomic_load_n(&use_avx2, __ATOMIC_RELAXED);
+    if(avx2 < 0) {
+#ifdef ENTITY_X86
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+        avx2 = 0;
+#endif
+        __atomic_store_n(&use_avx2, avx2, __ATOMIC_RELAXED);
+    }
+    return avx2;
+}
+
+static void update_batches(void* data, int batch_begin, int batch_end) {
+    const UpdateJob* job = data;
+    for(int b = batch_begin; b < batch_end; b++) {
+#ifdef ENTITY_X86
+        if(job->avx2) {
+            update_batch_avx2(job, b * ENTITY_BATCH);
+            continue;
+        }
+#endif
+        update_batch_scalar(job, b * ENTITY_BATCH);
+    }
+}
+
+void entity_update(World* world, float delta_time) {
+    PROFILE_BEGIN(ZONE_ENTITY_UPDATE);
+    EntityStore* entities = &world->entities;
+    // Timers draw from the world's sequence, so they stay serial and in
+    // index order
+    for(int i = 0; i < entities->count; i++) {
+        if((entities->flags[i] & (ENTITY_ALIVE | ENTITY_STATIC | ENTITY_CHASER)) != ENTITY_ALIVE) continue;
+        entities->move_timer[i] -= delta_time;
+        if(entities->move_timer[i] <= 0) {
+            entity_randomize_direction(world, i);
+        }
+    }
+
+    // An empty store may not have its arrays yet
+    if(entities->count > 0) {
+        memcpy(entities->prev_x, entities->x, entities->count * sizeof(float));
+        memcpy(entities->prev_y, entities->y, entities->count * sizeof(float));
+    }
+
+    UpdateJob job = {entities, world->map, world->camera.posX, world->camera.posY, entity_use_avx2()};
+    int batches = (entities->count + ENTITY_BATCH - 1) / ENTITY_BATCH;
+    parallel_for(batches, ENTITY_UPDATE_GRAIN, update_batches, &job);
+
+    spatial_rebuild(world);
+    PROFILE_END(ZONE_ENTITY_UPDATE);
+}
@@ -0,0 +1,90 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include <stdint.h>
+
+typedef struct World World;
+
+// Description of an entity to spawn; the store itself keeps each field in
+// its own array (see EntityStore)
+typedef struct {
+    float x, y;
+    float dx, dy;
+    float move_timer;
+    int texture_id;
+    int visible;
+    int is_chaser;
+    int is_static;      // never moved by entity_update(), e.g. pickups
+} Entity;
+
+enum ENTITY_FLAGS {
+    ENTITY_ALIVE = 1,   // cleared when the slot is despawned
+    ENTITY_VISIBLE = 2,
+    ENTITY_CHASER = 4,
+    ENTITY_STATIC = 8
+};
+
+// Structure of arrays, one element per slot in [0, count). The arrays are
+// padded to a multiple of ENTITY_BATCH so the update kernel can always work
+// in whole batches. Dead slots stay in place until a spawn reuses them, so
+// indices never shift. The arrays may move when they grow: keep handles,
+// not pointers, across spawns. A zeroed store is empty.
+typedef struct {
+    float* x;
+    float* y;
+    float* dx;
+    float* dy;
+    float* move_timer;
+    float* prev_x;      // position before the last entity_update(), so
+    float* prev_y;      // rendering can interpolate between ticks
+    int32_t* texture_id;
+    uint8_t* flags;
+
+    int count;
+    unsigned version;   // changes on every spawn and despawn, unique per process
+
+    int capacity;
+    uint8_t* generations;
+    int* free_slots;
+    int free_count;
+} EntityStore;
+
+#define ENTITY_BATCH 8
+
+// Slot index in the low bits, the slot's generation in the high bits, so a
+// handle to a despawned entity stops resolving once its slot is reused
+typedef uint32_t EntityHandle;
+
+#define ENTITY_INDEX_BITS 24
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_NONE 0xFFFFFFFFu
+
+EntityHandle entity_spawn(EntityStore* store, Entity e);
+void entity_despawn(EntityStore* store, EntityHandle handle);
+// Slot index for a live handle, -1 once it has gone stale
+int entity_index(const EntityStore* store, EntityHandle handle);
+EntityHandle entity_handle(const EntityStore* store, int index);
+// Despawns everything, keeping the arrays for reuse
+void entity_clear(EntityStore* store);
+void entity_store_free(EntityStore* store);
+
+static inline int entity_alive(const EntityStore* store, int i) {
+    return store->flags[i] & ENTITY_ALIVE;
+}
+
+static inline int entity_visible(const EntityStore* store, int i) {
+    return (store->flags[i] & (ENTITY_ALIVE | ENTITY_VISIBLE)) == (ENTITY_ALIVE | ENTITY_VISIBLE);
+}
+
+// New heading and timer for entity i, drawn from the world's sequence
+void entity_randomize_direction(World* world, int i);
+
+// Advances every live, non-static entity of the world by one update:
+// wanderers count down their timer and pick a new heading when it runs
+// out, chasers head for the player, then both move with wall collision and
+// are kept inside the map. Movement runs in batches of ENTITY_BATCH (AVX2
+// when available) split across the thread pool; results match the scalar
+// path exactly. Finishes by re-bucketing the spatial grid (see spatial.h).
+void entity_update(World* world, float delta_time);
+
+#endif
@@ -0,0 +1,253 @@
+#include "frame_server.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Real time a free-running server may fall behind before it stops trying
+// to catch up, as in the game loop
+#define MAX_LAG_SECONDS 0.25
+
+struct FrameServer {
+    FrameServerHeader* header;
+    size_t size;
+    char name[128];
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    Instance* instances;    // one per session, from the caller
+    RenderView** views;     // each instance's view, only set when it renders
+    Instance* batch;        // sessions stepped this round
+    int* batch_session;
+    uint32_t* batch_seq;    // action_seq each stepped session was at
+    uint64_t* ticks;
+};
+
+static size_t align64(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+static void* create_shared(FrameServer* server, size_t size) {
+#ifdef _WIN32
+    server->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                         (DWORD)((uint64_t)size >> 32), (DWORD)size, server->name);
+    if(!server->mapping) return NULL;
+    void* view = MapViewOfFile(server->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if(!view) CloseHandle(server->mapping);
+    return view;
+#else
+    // A block left by a server that died is replaced; clients still
+    // holding it keep it until they unmap
+    shm_unlink(server->name);
+    int fd = shm_open(server->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0) return NULL;
+    void* view = NULL;
+    if(ftruncate(fd, (off_t)size) == 0) {
+        view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(view == MAP_FAILED) view = NULL;
+    }
+    close(fd);
+    if(!view) shm_unlink(server->name);
+    return view;
+#endif
+}
+
+static void destroy_shared(FrameServer* server) {
+#ifdef _WIN32
+    UnmapViewOfFile(server->header);
+    CloseHandle(server->mapping);
+#else
+    munmap(server->header, server->size);
+    shm_unlink(server->name);
+#endif
+}
+
+FrameServer* frame_server_create(const char* name, Instance* instances, int count, int slots, int mode) {
+    if(count <= 0 || slots <= 0 || slots > FRAME_SERVER_MAX_SLOTS || strlen(name) >= sizeof(((FrameServer*)0)->name)) {
+        return NULL;
+    }
+    FrameServer* server = calloc(1, sizeof(FrameServer));
+    if(!server) return NULL;
+    strcpy(server->name, name);
+    server->instances = instances;
+    server->views = calloc(count, sizeof(RenderView*));
+    server->batch = calloc(count, sizeof(Instance));
+    server->batch_session = calloc(count, sizeof(int));
+    server->batch_seq = calloc(count, sizeof(uint32_t));
+    server->ticks = calloc(count, sizeof(uint64_t));
+
+    const Surface* frame = render_target(instances[0].view);
+    size_t frame_bytes = align64((size_t)frame->width * frame->height * sizeof(uint32_t));
+    size_t session_offset = align64(sizeof(FrameServerHeader));
+    size_t frame_offset = align64(session_offset + count * sizeof(FrameSession));
+    server->size = frame_offset + (size_t)count * slots * frame_bytes;
+
+    if(server->views && server->batch && server->batch_session && server->batch_seq && server->ticks) {
+        server->header = create_shared(server, server->size);
+    }
+    if(!server->header) {
+        fprintf(stderr, "Failed to create shared memory %s\n", name);
+        server->size = 0;
+        frame_server_destroy(server);
+        return NULL;
+    }
+
+    // Fresh mappings read as zero, so every session starts with no input
+    // and no frames
+    FrameServerHeader* header = server->header;
+    header->version = FRAME_SERVER_VERSION;
+    header->mode = mode;
+    header->session_count = count;
+    header->slot_count = slots;
+    header->width = frame->width;
+    header->height = frame->height;
+    header->session_offset = session_offset;
+    header->frame_offset = frame_offset;
+    header->frame_bytes = frame_bytes;
+    for(int i = 0; i < count; i++) server->views[i] = instances[i].view;
+    // Clients check the magic last, once the rest is in place
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, FRAME_SERVER_MAGIC, 4);
+    return server;
+}
+
+void frame_server_destroy(FrameServer* server) {
+    if(!server) return;
+    if(server->header) {
+        // Give the views back their own frames
+        for(int i = 0; i < (int)server->header->session_count; i++) render_set_target(server->views[i], NULL);
+        destroy_shared(server);
+    }
+    free(server->views);
+    free(server->batch);
+    free(server->batch_session);
+    free(server->batch_seq);
+    free(server->ticks);
+    free(server);
+}
+
+FrameServerHeader* frame_server_header(FrameServer* server) {
+    return server->header;
+}
+
+static int ring_full(const FrameServer* server, FrameSession* session) {
+    uint32_t read = __atomic_load_n(&session->frames_read, __ATOMIC_ACQUIRE);
+    return session->frames_written - read >= server->header->slot_count;
+}
+
+// Adds session i to this round's batch, drawing into its next slot when
+// `render` is set
+static void batch_session(FrameServer* server, int n, int i, unsigned input, uint32_t seq, int render) {
+    FrameSession* session = frame_server_session(server->header, i);
+    Instance* instance = &server->batch[n];
+    *instance = server->instances[i];
+    instance->input = input;
+    instance->view = render ? server->views[i] : NULL;
+    if(render) render_set_target(instance->view, frame_server_pixels(server->header, i, session->frames_written));
+    server->batch_session[n] = i;
+    server->batch_seq[n] = seq;
+}
+
+// Steps the batch, then publishes each rendered frame with the UIState it
+// shows before the counters that hand it to the client
+static void step_batch(FrameServer* server, int n) {
+    scheduler_step(server->batch, n);
+    for(int b = 0; b < n; b++) {
+        int i = server->batch_session[b];
+        FrameSession* session = frame_server_session(server->header, i);
+        server->ticks[i]++;
+        if(server->batch[b].view) {
+            FrameInfo* info = &session->frames[session->frames_written % server->header->slot_count];
+            info->tick = server->ticks[i];
+            info->ui = server->batch[b].world->ui;
+            __atomic_store_n(&session->frames_written, session->frames_written + 1, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&session->frames_dropped, session->frames_dropped + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&session->actions_seen, server->batch_seq[b], __ATOMIC_RELEASE);
+    }
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_seconds(double seconds) {
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// Waiting for clients: spin briefly, since a client replying at once is
+// the common case, then yield, then sleep
+static void idle(int rounds) {
+    if(rounds < 64) return;
+#ifdef _WIN32
+    if(rounds < 1024) Sleep(0);
+#else
+    if(rounds < 1024) sched_yield();
+#endif
+    else sleep_seconds(0.0001);
+}
+
+static int stopped(const FrameServer* server) {
+    return __atomic_load_n(&server->header->shutdown, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void run_lockstep(FrameServer* server) {
+    int count = server->header->session_count;
+    for(int rounds = 0; !stopped(server); ) {
+        int n = 0;
+        for(int i = 0; i < count; i++) {
+            FrameSession* session = frame_server_session(server->header, i);
+            uint32_t seq = __atomic_load_n(&session->action_seq, __ATOMIC_ACQUIRE);
+            if(seq == session->actions_seen || ring_full(server, session)) continue;
+            unsigned input = __atomic_load_n(&session->input, __ATOMIC_RELAXED);
+            batch_session(server, n++, i, input, seq, 1);
+        }
+        if(n == 0) {
+            idle(rounds++);
+            continue;
+        }
+        step_batch(server, n);
+        rounds = 0;
+    }
+}
+
+static void run_free(FrameServer* server) {
+    int count = server->header->session_count;
+    double next_tick = now_seconds();
+    while(!stopped(server)) {
+        for(int i = 0; i < count; i++) {
+            FrameSession* session = frame_server_session(server->header, i);
+            uint32_t seq = __atomic_load_n(&session->action_seq, __ATOMIC_ACQUIRE);
+            unsigned input = __atomic_load_n(&session->input, __ATOMIC_RELAXED);
+            if(seq == session->actions_seen) input &= ~INPUT_FIRE;
+            batch_session(server, i, i, input, seq, !ring_full(server, session));
+        }
+        step_batch(server, count);
+
+        next_tick += TICK_SECONDS;
+        double now = now_seconds();
+        if(now - next_tick > MAX_LAG_SECONDS) next_tick = now;
+        if(next_tick > now) sleep_seconds(next_tick - now);
+    }
+}
+
+void frame_server_run(FrameServer* server) {
+    if(server->header->mode == FRAME_SERVER_LOCKSTEP) run_lockstep(server);
+    else run_free(server);
+}
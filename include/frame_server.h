@@ -0,0 +1,90 @@
+#ifndef FRAME_SERVER_H
+#define FRAME_SERVER_H
+
+#include "scheduler.h"
+#include <stdint.h>
+
+// Headless sessions driven by another process through one shared memory
+// block. Each session is a world with its own view; the client writes
+// inputs (WORLD_INPUT bits) into the session, and the server renders every
+// frame straight into a ring of frame slots in the block, next to the
+// UIState it shows, so a frame is never copied on either side. Counters
+// in the block are the only synchronisation: each is written by one side
+// only, read with acquire and written with release ordering.
+#define FRAME_SERVER_MAGIC "RCFS"
+#define FRAME_SERVER_VERSION 1
+#define FRAME_SERVER_MAX_SLOTS 8
+
+enum FRAME_SERVER_MODES {
+    // A session ticks once per action, as soon as its client bumps
+    // action_seq and has a free slot. Sessions with pending actions are
+    // stepped together as one batch.
+    FRAME_SERVER_LOCKSTEP,
+    // Every session ticks at TICK_RATE on its latest input, whether or not
+    // its client keeps up. While a session's ring is full its frames are
+    // dropped, never overwritten.
+    FRAME_SERVER_FREE_RUNNING
+};
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t mode;
+    uint32_t session_count;
+    uint32_t slot_count;        // frames in each session's ring
+    uint32_t width, height;     // of every frame, ARGB pixels
+    uint32_t shutdown;          // either side sets it to stop the server
+    uint64_t session_offset;    // session_count FrameSessions
+    uint64_t frame_offset;      // session_count * slot_count frames
+    uint64_t frame_bytes;       // apart, each width * height * 4 used
+    uint8_t reserved[16];
+} FrameServerHeader;
+
+typedef struct {
+    uint64_t tick;              // world ticks so far, counting this frame's
+    UIState ui;                 // after that tick
+} FrameInfo;
+
+// Client and server fields sit on separate cache lines
+typedef struct {
+    // Written by the client
+    uint32_t input;             // WORLD_INPUT bits, held until changed
+    uint32_t action_seq;        // bumped after writing input. INPUT_FIRE
+                                // only counts on the first tick after a bump.
+    uint32_t frames_read;       // frames the client is done with
+    uint8_t client_reserved[52];
+
+    // Written by the server
+    uint32_t frames_written;    // frame n is in slot n % slot_count
+    uint32_t actions_seen;      // action_seq as of the latest tick
+    uint32_t frames_dropped;    // free-running ticks that found the ring full
+    uint8_t server_reserved[52];
+
+    FrameInfo frames[FRAME_SERVER_MAX_SLOTS];
+} FrameSession;
+
+static inline FrameSession* frame_server_session(FrameServerHeader* header, int session) {
+    return (FrameSession*)((uint8_t*)header + header->session_offset) + session;
+}
+
+// Pixels of frame number `frame` of a session
+static inline uint32_t* frame_server_pixels(FrameServerHeader* header, int session, uint32_t frame) {
+    uint64_t index = (uint64_t)session * header->slot_count + frame % header->slot_count;
+    return (uint32_t*)((uint8_t*)header + header->frame_offset + index * header->frame_bytes);
+}
+
+typedef struct FrameServer FrameServer;
+
+// Creates the shared memory block `name` (a POSIX shm name such as
+// "/raycast", or a Windows mapping name) for one session per instance.
+// Instances need a world and a view each, all views of the same size;
+// the server owns their inputs from then on. NULL on failure.
+FrameServer* frame_server_create(const char* name, Instance* instances, int count, int slots, int mode);
+// Removes the block; clients still mapping it keep their view of it
+void frame_server_destroy(FrameServer* server);
+FrameServerHeader* frame_server_header(FrameServer* server);
+
+// Serves until the header's shutdown flag is set
+void frame_server_run(FrameServer* server);
+
+#endif
@@ -1,82 +1,215 @@
-#include "graphic.h"
-#include "font.h"
-#include <SDL2/SDL.h>
-#include <math.h>
-#include <string.h>
-#include <stdbool.h>
-#include <stdint.h>
-
-uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-void plot(uint16_t x, uint16_t y, uint32_t color) {
-    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) return;
-    framebuffer[y * SCREEN_WIDTH + x] = color;
-}
-
-void line(int x0, int y0, int x1, int y1, uint32_t color) {
-    int dx = abs(x1 - x0);
-    int dy = -abs(y1 - y0);
-    int sx = x0 < x1 ? 1 : -1;
-    int sy = y0 < y1 ? 1 : -1;
-    int err = dx + dy;
-
-    while (1) {
-        plot(x0, y0, color);
-        if (x0 == x1 && y0 == y1) break;
-        int e2 = 2 * err;
-        if (e2 >= dy) {
-            err += dy;
-            x0 += sx;
-        }
-        if (e2 <= dx) {
-            err += dx;
-            y0 += sy;
-        }
-    }
-}
-
-int load_texture(const char* path, Texture* tex) {
-    SDL_Surface* surface = SDL_LoadBMP(path);
-    if (!surface) return 0;
-
-    SDL_Surface* converted = SDL_ConvertSurfaceFormat(
-        surface, SDL_PIXELFORMAT_ARGB8888, 0
-    );
-    SDL_FreeSurface(surface);
-
-    if (!converted) return 0;
-    
-    tex->width = converted->w;
-    tex->height = converted->h;
-    tex->pixels = malloc(tex->width * tex->height * sizeof(Uint32));
-    
-    SDL_LockSurface(converted);
-    memcpy(tex->pixels, converted->pixels, 
-           tex->width * tex->height * sizeof(Uint32));
-    SDL_UnlockSurface(converted);
-    SDL_FreeSurface(converted);
-    
-    return 1;
-}
-
-void draw_char(uint16_t x, uint16_t y, char c, uint32_t color) {
-    // Use 0x20-0x7E range
-    if(c < 0x20 || c > 0x7E) return; // Only render printable ASCII
-    
-    const uint8_t* glyph = font_bitmap[(unsigned char)c];
-    for(int row = 0; row < 8; row++) {
-        for(int col = 0; col < 8; col++) {
-            if(glyph[row] & (1 << col)) {
-                plot(x + col, y + row, color);
-            }
-        }
-    }
-}
-
-void draw_string(uint16_t x, uint16_t y, const char* str, uint32_t color) {
-    uint16_t current_x = x;
-    while(*str) {
-        draw_char(current_x, y, *str++, color);
-        current_x += FONT_CHAR_WIDTH + 1;
-    }
-}
\ No newline at end of file
+#include "graphic.h"
+#include "font.h"
+#ifndef HEADLESS
+#include <SDL2/SDL.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+int surface_resize(Surface* surface, int w, int h) {
+    if(w < 8) w = 8;
+    if(h < 8) h = 8;
+    if(w > MAX_SCREEN_WIDTH) w = MAX_SCREEN_WIDTH;
+    if(h > MAX_SCREEN_HEIGHT) h = MAX_SCREEN_HEIGHT;
+    w = (w + 7) & ~7;
+    if(surface->storage && w == surface->width && h == surface->height) return 1;
+
+    uint32_t* pixels = calloc((size_t)w * h, sizeof(uint32_t));
+    if(!pixels) return 0;
+    free(surface->storage);
+    surface->pixels = surface->storage = pixels;
+    surface->width = w;
+    surface->height = h;
+    return 1;
+}
+
+void surface_set_pixels(Surface* surface, uint32_t* pixels) {
+    surface->pixels = pixels ? pixels : surface->storage;
+}
+
+void surface_free(Surface* surface) {
+    free(surface->storage);
+    *surface = (Surface){NULL, 0, 0, NULL};
+}
+
+// Texel positions step in 16.16 fixed point, like the wall and sprite
+// samplers. Texture columns are contiguous (see Texture), so the blit runs
+// column by column.
+void blit_keyed(Surface* surface, const Texture* tex, int src_x, int src_y, int src_w, int src_h,
+                int dst_x, int dst_y, int dst_w, int dst_h, uint32_t key) {
+    if(dst_w <= 0 || dst_h <= 0) return;
+    int width = surface->width, height = surface->height;
+    int x0 = dst_x < 0 ? 0 : dst_x, x1 = dst_x + dst_w > width ? width : dst_x + dst_w;
+    int y0 = dst_y < 0 ? 0 : dst_y, y1 = dst_y + dst_h > height ? height : dst_y + dst_h;
+    if(x0 >= x1 || y0 >= y1) return;
+
+    uint32_t stepX = ((uint32_t)src_w << 16) / dst_w;
+    uint32_t stepY = ((uint32_t)src_h << 16) / dst_h;
+    uint32_t texY0 = (y0 - dst_y) * stepY;
+    uint32_t texX = (x0 - dst_x) * stepX;
+    key &= 0xFFFFFF;
+    int stride = width;
+
+    for(int x = x0; x < x1; x++, texX += stepX) {
+        const uint32_t* column = tex->pixels + (src_x + (texX >> 16)) * tex->height + src_y;
+        uint32_t* out = surface->pixels + y0 * stride + x;
+        uint32_t texY = texY0;
+        for(int y = y0; y < y1; y++, out += stride, texY += stepY) {
+            uint32_t color = column[texY >> 16];
+            if((color & 0xFFFFFF) != key) *out = color;
+        }
+    }
+}
+
+#ifdef HEADLESS
+static uint32_t read_le(const uint8_t* p, int bytes) {
+    uint32_t v = 0;
+    for(int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Minimal BMP reader for builds without SDL: uncompressed 8, 24 and
+// 32 bit images, converted to ARGB8888 like SDL_ConvertSurfaceFormat.
+int load_texture(const char* path, Texture* tex) {
+    FILE* file = fopen(path, "rb");
+    if(!file) return 0;
+
+    uint8_t header[54];
+    if(fread(header, 1, sizeof(header), file) != sizeof(header) ||
+       header[0] != 'B' || header[1] != 'M') {
+        fclose(file);
+        return 0;
+    }
+
+    uint32_t data_offset = read_le(header + 10, 4);
+    uint32_t info_size = read_le(header + 14, 4);
+    int width = (int32_t)read_le(header + 18, 4);
+    int height = (int32_t)read_le(header + 22, 4);
+    int bpp = read_le(header + 28, 2);
+    uint32_t compression = read_le(header + 30, 4);
+    uint32_t palette_count = read_le(header + 46, 4);
+
+    int bottom_up = height > 0;
+    if(height < 0) height = -height;
+    if(width <= 0 || compression != 0 || (bpp != 8 && bpp != 24 && bpp != 32)) {
+        fclose(file);
+        return 0;
+    }
+
+    uint32_t palette[256] = {0};
+    if(bpp == 8) {
+        if(palette_count == 0 || palette_count > 256) palette_count = 256;
+        uint8_t entry[4];
+        fseek(file, 14 + info_size, SEEK_SET);
+        for(uint32_t i = 0; i < palette_count; i++) {
+            if(fread(entry, 1, 4, file) != 4) break;
+            palette[i] = 0xFF000000 | (entry[2] << 16) | (entry[1] << 8) | entry[0];
+        }
+    }
+
+    int row_size = ((width * bpp + 31) / 32) * 4;
+    uint8_t* row = malloc(row_size);
+    tex->width = width;
+    tex->height = height;
+    tex->pixels = malloc(width * height * sizeof(uint32_t));
+
+    // Written transposed, see Texture
+    fseek(file, data_offset, SEEK_SET);
+    for(int y = 0; y < height; y++) {
+        if(fread(row, 1, row_size, file) != (size_t)row_size) break;
+        uint32_t* out = tex->pixels + (bottom_up ? height - 1 - y : y);
+        for(int x = 0; x < width; x++) {
+            if(bpp == 8) {
+                out[x * height] = palette[row[x]];
+            } else {
+                const uint8_t* px = row + x * (bpp / 8);
+                out[x * height] = 0xFF000000 | (px[2] << 16) | (px[1] << 8) | px[0];
+            }
+        }
+    }
+
+    free(row);
+    fclose(file);
+    return 1;
+}
+#else
+int load_texture(const char* path, Texture* tex) {
+    SDL_Surface* surface = SDL_LoadBMP(path);
+    if (!surface) return 0;
+
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(
+        surface, SDL_PIXELFORMAT_ARGB8888, 0
+    );
+    SDL_FreeSurface(surface);
+
+    if (!converted) return 0;
+    
+    tex->width = converted->w;
+    tex->height = converted->h;
+    tex->pixels = malloc(tex->width * tex->height * sizeof(uint32_t));
+    
+    // Transposed into column-major order, see Texture
+    SDL_LockSurface(converted);
+    for(int y = 0; y < tex->height; y++) {
+        const uint32_t* row = (const uint32_t*)((const uint8_t*)converted->pixels + y * converted->pitch);
+        for(int x = 0; x < tex->width; x++) {
+            tex->pixels[x * tex->height + y] = row[x];
+        }
+    }
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+    
+    return 1;
+}
+#endif
+
+// font_bitmap expanded to one all-ones or all-zeros word per pixel, so a
+// glyph row is drawn with a branchless select instead of testing bits
+#define GLYPH_FIRST 0x20
+#define GLYPH_COUNT (0x7F - GLYPH_FIRST)
+static uint32_t glyph_masks[GLYPH_COUNT][FONT_CHAR_HEIGHT][FONT_CHAR_WIDTH];
+static int glyph_masks_ready = 0;   // read and set atomically, HUDs may draw on any thread
+
+static void expand_glyphs() {
+    for(int c = 0; c < GLYPH_COUNT; c++) {
+        for(int row = 0; row < FONT_CHAR_HEIGHT; row++) {
+            for(int col = 0; col < FONT_CHAR_WIDTH; col++) {
+                int set = font_bitmap[c + GLYPH_FIRST][row] & (1 << col);
+                glyph_masks[c][row][col] = set ? 0xFFFFFFFF : 0;
+            }
+        }
+    }
+    __atomic_store_n(&glyph_masks_ready, 1, __ATOMIC_RELEASE);
+}
+
+void draw_char(Surface* surface, int x, int y, char c, uint32_t color) {
+    // Use 0x20-0x7E range
+    if(c < 0x20 || c > 0x7E) return; // Only render printable ASCII
+    if(!__atomic_load_n(&glyph_masks_ready, __ATOMIC_ACQUIRE)) expand_glyphs();
+    int w = surface->width, h = surface->height;
+
+    // Clip the 8x8 cell once, then write rows directly
+    int row0 = y < 0 ? -y : 0;
+    int row1 = y + FONT_CHAR_HEIGHT > h ? h - y : FONT_CHAR_HEIGHT;
+    int col0 = x < 0 ? -x : 0;
+    int col1 = x + FONT_CHAR_WIDTH > w ? w - x : FONT_CHAR_WIDTH;
+
+    for(int row = row0; row < row1; row++) {
+        uint32_t* out = surface->pixels + (y + row) * w + x;
+        const uint32_t* mask = glyph_masks[c - GLYPH_FIRST][row];
+        for(int col = col0; col < col1; col++) {
+            out[col] = (out[col] & ~mask[col]) | (color & mask[col]);
+        }
+    }
+}
+
+void draw_string(Surface* surface, int x, int y, const char* str, uint32_t color) {
+    while(*str) {
+        draw_char(surface, x, y, *str++, color);
+        x += FONT_CHAR_WIDTH + 1;
+    }
+}
@@ -1,31 +1,65 @@
-#ifndef GRAPHIC_H
-#define GRAPHIC_H
-
-#include <stdint.h>
-#include <SDL2/SDL.h>
-
-#define SCREEN_WIDTH 320
-#define SCREEN_HEIGHT 240
-
-#define FONT_CHAR_WIDTH 8
-#define FONT_CHAR_HEIGHT 8
-
-#define TEX_SIZE 64
-
-typedef struct {
-    Uint32* pixels;
-    int width;
-    int height;
-} Texture;
-
-extern uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-void plot(uint16_t x, uint16_t y, uint32_t color);
-void line(int x0, int y0, int x1, int y1, uint32_t color);
-
-int load_texture(const char* path, Texture* tex);
-
-void draw_char(uint16_t x, uint16_t y, char c, uint32_t color);
-void draw_string(uint16_t x, uint16_t y, const char* str, uint32_t color);
-
+#ifndef GRAPHIC_H
+#define GRAPHIC_H
+
+#include <stdint.h>
+#ifndef HEADLESS
+#include <SDL2/SDL.h>
+#endif
+
+// Internal render resolution, chosen at startup or changed between frames
+// with render_set_resolution() (render.h); the window scales it to fit
+#define DEFAULT_SCREEN_WIDTH 320
+#define DEFAULT_SCREEN_HEIGHT 240
+#define MAX_SCREEN_WIDTH 3840
+#define MAX_SCREEN_HEIGHT 2160
+
+#define FONT_CHAR_WIDTH 8
+#define FONT_CHAR_HEIGHT 8
+
+#define MAX_MIP_LEVELS 8
+
+// Pixels are stored column-major, texel (x, y) at pixels[x * height + y],
+// because walls and sprites are drawn one screen column at a time and
+// then read a texture column top to bottom
+typedef struct {
+    uint32_t* pixels;
+    int width;
+    int height;
+    // Filled in by the texture manager (texture.h). Square power-of-two
+    // textures get a mip chain, level n being (width >> n) square; anything
+    // else has just level 0 and shift -1.
+    int levels;
+    int shift;
+    uint32_t* mips[MAX_MIP_LEVELS];
+} Texture;
+
+// Row-major pixels every drawing primitive writes into: a frame, a cached
+// layer, or memory owned by someone else such as a locked texture
+typedef struct {
+    uint32_t* pixels;
+    int width;
+    int height;
+    uint32_t* storage;  // what surface_resize() allocated, if anything
+} Surface;
+
+// Reallocates the surface at w x h, clamped to 8..MAX_SCREEN_*; width is
+// rounded up to a multiple of 8 so SIMD passes never need a tail. Returns 0
+// if the allocation fails, leaving the old pixels in place.
+int surface_resize(Surface* surface, int w, int h);
+// Points the surface at width x height pixels owned by the caller until
+// called again; NULL goes back to the ones surface_resize() allocated
+void surface_set_pixels(Surface* surface, uint32_t* pixels);
+void surface_free(Surface* surface);
+
+// Scales the src_w x src_h region of tex at (src_x, src_y) to dst_w x dst_h
+// at (dst_x, dst_y), skipping texels whose RGB equals key. Clips against
+// the surface once, then writes whole columns.
+void blit_keyed(Surface* surface, const Texture* tex, int src_x, int src_y, int src_w, int src_h,
+                int dst_x, int dst_y, int dst_w, int dst_h, uint32_t key);
+
+int load_texture(const char* path, Texture* tex);
+
+void draw_char(Surface* surface, int x, int y, char c, uint32_t color);
+void draw_string(Surface* surface, int x, int y, const char* str, uint32_t color);
+
 #endif
\ No newline at end of file
@@ -1,83 +1,499 @@
-#include "map.h"
-#include <SDL2/SDL.h>
-#include <stdio.h>
-#include <string.h>
-#include <math.h>
-#include <stdlib.h>
-
-// Properly define the global variables
-int** world_map = NULL;
-int map_width = 0;
-int map_height = 0;
-
-float posX = 3.5f, posY = 3.5f;
-float dirX = 1.0f, dirY = 0.0f;
-float planeX = 0.0f, planeY = 0.66f;
-
-void free_map() {
-    if(world_map) {
-        for(int i = 0; i < map_height; i++) {
-            free(world_map[i]);
-        }
-        free(world_map);
-        world_map = NULL;
-    }
-}
-
-int load_map(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if(!file) return 0;
-
-    char line[256];
-    int section = 0;
-    int row = 0;
-
-    while(fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-
-        if(strcmp(line, "[metadata]") == 0) {
-            section = 1;
-        }
-        else if(strcmp(line, "[player]") == 0) {
-            section = 2;
-        }
-        else if(strcmp(line, "[map]") == 0) {
-            section = 3;
-            // Allocate 2D array
-            world_map = malloc(map_height * sizeof(int*));
-            for(int i = 0; i < map_height; i++) {
-                world_map[i] = malloc(map_width * sizeof(int));
-            }
-        }
-        else if(section == 1) {
-            if(sscanf(line, "width=%d", &map_width) == 1) continue;
-            if(sscanf(line, "height=%d", &map_height) == 1) continue;
-        }
-        else if(section == 2) {
-            float angle;
-            if(sscanf(line, "posX=%f", &posX) == 1) continue;
-            if(sscanf(line, "posY=%f", &posY) == 1) continue;
-            if(sscanf(line, "angle=%f", &angle) == 1) {
-                float rad = angle * (M_PI / 180.0f);
-                dirX = cos(rad);
-                dirY = sin(rad);
-                planeX = -dirY * 0.66f;
-                planeY = dirX * 0.66f;
-                continue;
-            }
-        }
-        else if(section == 3) {
-            if(row >= map_height) continue;
-            
-            char* token = strtok(line, " ");
-            for(int col = 0; col < map_width && token; col++) {
-                world_map[row][col] = atoi(token);
-                token = strtok(NULL, " ");
-            }
-            row++;
-        }
-    }
-
-    fclose(file);
-    return 1;
-}
\ No newline at end of file
+#include "map.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Where a map without a [player] section starts
+static const Camera default_spawn = {3.5f, 3.5f, 1.0f, 0.0f, 0.0f, 0.66f};
+
+void map_set(Map* map, int x, int y, int value) {
+    if(value < 0) value = 0;
+    if(value > 255) value = 255;
+
+    MapGrid* grid = &map->grid;
+    int tile = map_tile_index(map, x, y);
+    int bit = map_tile_bit(x, y);
+    grid->material[tile * MAP_TILE_CELLS + bit] = value;
+    if(value > 0) {
+        // Geometry may now sit inside a region marked empty
+        if(!grid->solid[tile]) grid->distance_valid = 0;
+        grid->solid[tile] |= 1ull << bit;
+    } else {
+        grid->solid[tile] &= ~(1ull << bit);
+    }
+}
+
+// Two-pass chamfer transform; with unit weights on all eight neighbours it
+// gives the exact Chebyshev distance. Tiles past the grid edge count as
+// occupied so a skip never leaves the map.
+void map_build_distance(Map* map) {
+    MapGrid* grid = &map->grid;
+    int tx_count = grid->tiles_x, ty_count = grid->tiles_y;
+    uint8_t* dist = grid->tile_distance;
+
+    for(int tx = 0; tx < tx_count; tx++) {
+        for(int ty = 0; ty < ty_count; ty++) {
+            int i = tx * ty_count + ty;
+            if(grid->solid[i]) {
+                dist[i] = 0;
+                continue;
+            }
+            int d = 255;
+            if(tx == 0 || ty == 0 || ty == ty_count - 1) d = 1;
+            else {
+                if(dist[i - 1] + 1 < d) d = dist[i - 1] + 1;
+                if(dist[i - ty_count - 1] + 1 < d) d = dist[i - ty_count - 1] + 1;
+                if(dist[i - ty_count] + 1 < d) d = dist[i - ty_count] + 1;
+                if(dist[i - ty_count + 1] + 1 < d) d = dist[i - ty_count + 1] + 1;
+            }
+            dist[i] = d;
+        }
+    }
+
+    for(int tx = tx_count - 1; tx >= 0; tx--) {
+        for(int ty = ty_count - 1; ty >= 0; ty--) {
+            int i = tx * ty_count + ty;
+            int d = dist[i];
+            if(d == 0) continue;
+            if(tx == tx_count - 1 || ty == 0 || ty == ty_count - 1) d = 1;
+            else {
+                if(dist[i + 1] + 1 < d) d = dist[i + 1] + 1;
+                if(dist[i + ty_count - 1] + 1 < d) d = dist[i + ty_count - 1] + 1;
+                if(dist[i + ty_count] + 1 < d) d = dist[i + ty_count] + 1;
+                if(dist[i + ty_count + 1] + 1 < d) d = dist[i + ty_count + 1] + 1;
+            }
+            dist[i] = d;
+        }
+    }
+
+    grid->distance_valid = 1;
+}
+
+static void unmap_view(Map* map) {
+#ifdef _WIN32
+    UnmapViewOfFile(map->view);
+    CloseHandle(map->mapping_handle);
+    CloseHandle(map->file_handle);
+    map->mapping_handle = map->file_handle = NULL;
+#else
+    munmap(map->view, map->view_size);
+#endif
+    map->view = NULL;
+    map->view_size = 0;
+}
+
+void free_map(Map* map) {
+    if(map->view) {
+        unmap_view(map);
+    } else {
+        free(map->grid.material);
+        free(map->grid.solid);
+        free(map->grid.tile_distance);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+int alloc_map(Map* map, int width, int height) {
+    free_map(map);
+    map->width = width;
+    map->height = height;
+    map->spawn = default_spawn;
+
+    MapGrid* grid = &map->grid;
+    grid->tiles_x = (height + MAP_TILE_SIZE - 1) >> MAP_TILE_SHIFT;
+    grid->tiles_y = (width + MAP_TILE_SIZE - 1) >> MAP_TILE_SHIFT;
+
+    int tiles = grid->tiles_x * grid->tiles_y;
+    grid->material = calloc(tiles, MAP_TILE_CELLS);
+    grid->solid = calloc(tiles, sizeof(uint64_t));
+    // Padded so the packet raycaster can gather it as 32 bit words
+    grid->tile_distance = calloc(tiles + 3, 1);
+    if(!grid->material || !grid->solid || !grid->tile_distance) {
+        free_map(map);
+        return 0;
+    }
+    return 1;
+}
+
+// fgets into a buffer that grows until the whole line fits
+static char* read_line(FILE* file, char** buffer, size_t* capacity) {
+    size_t length = 0;
+    for(;;) {
+        if(*capacity - length < 2) {
+            size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+            char* grown = realloc(*buffer, grown_capacity);
+            if(!grown) return NULL;
+            *buffer = grown;
+            *capacity = grown_capacity;
+        }
+        if(!fgets(*buffer + length, (int)(*capacity - length), file)) {
+            return length > 0 ? *buffer : NULL;
+        }
+        length += strlen(*buffer + length);
+        if((*buffer)[length - 1] == '\n') return *buffer;
+    }
+}
+
+static void set_spawn_angle(Camera* spawn, float angle) {
+    float rad = angle * (M_PI / 180.0f);
+    spawn->dirX = cos(rad);
+    spawn->dirY = sin(rad);
+    spawn->planeX = -spawn->dirY * 0.66f;
+    spawn->planeY = spawn->dirX * 0.66f;
+}
+
+// The ray casters and collision never bounds-check a cell: they rely on
+// a solid border to stop them, and on the player starting inside it. Maps
+// without either are refused.
+static int map_playable(const Map* map) {
+    const Camera* spawn = &map->spawn;
+    const float values[6] = {spawn->posX, spawn->posY, spawn->dirX, spawn->dirY, spawn->planeX, spawn->planeY};
+    for(int i = 0; i < 6; i++) {
+        if(!isfinite(values[i])) return 0;
+    }
+    if(spawn->posX < 0.0f || spawn->posX >= map->height || spawn->posY < 0.0f || spawn->posY >= map->width) return 0;
+    if(map_is_solid(map, (int)spawn->posX, (int)spawn->posY)) return 0;
+
+    for(int x = 0; x < map->height; x++) {
+        if(!map_is_solid(map, x, 0) || !map_is_solid(map, x, map->width - 1)) return 0;
+    }
+    for(int y = 0; y < map->width; y++) {
+        if(!map_is_solid(map, 0, y) || !map_is_solid(map, map->height - 1, y)) return 0;
+    }
+    return 1;
+}
+
+static int load_map_text(Map* map, FILE* file) {
+    char* line = NULL;
+    size_t capacity = 0;
+    int section = 0;
+    int row = 0;
+    int width = 0, height = 0;
+    Camera spawn = default_spawn;
+
+    while(read_line(file, &line, &capacity)) {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if(strcmp(line, "[metadata]") == 0) {
+            section = 1;
+        }
+        else if(strcmp(line, "[player]") == 0) {
+            section = 2;
+        }
+        else if(strcmp(line, "[map]") == 0) {
+            section = 3;
+            // Allocate 2D array
+            if(!alloc_map(map, width, height)) {
+                free(line);
+                return 0;
+            }
+        }
+        else if(section == 1) {
+            if(sscanf(line, "width=%d", &width) == 1) continue;
+            if(sscanf(line, "height=%d", &height) == 1) continue;
+        }
+        else if(section == 2) {
+            float angle;
+            if(sscanf(line, "posX=%f", &spawn.posX) == 1) continue;
+            if(sscanf(line, "posY=%f", &spawn.posY) == 1) continue;
+            if(sscanf(line, "angle=%f", &angle) == 1) {
+                set_spawn_angle(&spawn, angle);
+                continue;
+            }
+        }
+        else if(section == 3) {
+            if(row >= map->height) continue;
+
+            char* cursor = line;
+            for(int col = 0; col < map->width; col++) {
+                char* end;
+                long value = strtol(cursor, &end, 10);
+                if(end == cursor) break;
+                map_set(map, row, col, (int)value);
+                cursor = end;
+            }
+            row++;
+        }
+    }
+
+    free(line);
+    if(!map->grid.material) return 0;
+    map->spawn = spawn;
+    if(!map_playable(map)) {
+        free_map(map);
+        return 0;
+    }
+    map_build_distance(map);
+    return 1;
+}
+
+static int map_header_valid(const MapFileHeader* header, uint64_t file_size) {
+    if(memcmp(header->magic, MAP_FILE_MAGIC, 4) != 0) return 0;
+    if(header->version != MAP_FILE_VERSION || header->file_size != file_size) return 0;
+    if(header->width == 0 || header->height == 0) return 0;
+    // Sizes land in int fields, and cells are indexed with int
+    if(header->width > INT_MAX || header->height > INT_MAX) return 0;
+    if(header->tiles_x != (header->height + MAP_TILE_SIZE - 1) >> MAP_TILE_SHIFT) return 0;
+    if(header->tiles_y != (header->width + MAP_TILE_SIZE - 1) >> MAP_TILE_SHIFT) return 0;
+
+    uint64_t tiles = (uint64_t)header->tiles_x * header->tiles_y;
+    if(tiles > INT_MAX / MAP_TILE_CELLS) return 0;
+    if(header->solid_offset % sizeof(uint64_t) != 0) return 0;
+    if(header->material_offset > file_size || header->solid_offset > file_size ||
+       header->distance_offset > file_size) return 0;
+    return header->material_offset + tiles * MAP_TILE_CELLS <= file_size &&
+           header->solid_offset + tiles * sizeof(uint64_t) <= file_size &&
+           header->distance_offset + tiles + 3 <= file_size;
+}
+
+// Maps the file copy-on-write, so map_set() still works and never writes
+// back to disk
+static void* map_file_view(Map* map, const char* filename, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    void* view = NULL;
+    if(GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(MapFileHeader)) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(mapping) view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    }
+    if(!view) {
+        if(mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return NULL;
+    }
+    map->file_handle = file;
+    map->mapping_handle = mapping;
+    *size = (size_t)file_size.QuadPart;
+    return view;
+#else
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return NULL;
+    struct stat info;
+    void* view = NULL;
+    if(fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(MapFileHeader)) {
+        view = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(view == MAP_FAILED) view = NULL;
+    }
+    (void)map;
+    close(fd);
+    if(view) *size = info.st_size;
+    return view;
+#endif
+}
+
+// Ray skips trust the distance plane, so one read from a file has to be
+// conservative: 0 on every tile with geometry, at most 1 on the edge tiles
+// and never more than one above a neighbour. By induction no tile then
+// claims more than its real distance to geometry or the grid edge.
+static int map_distance_valid(const MapGrid* grid) {
+    int tx_count = grid->tiles_x, ty_count = grid->tiles_y;
+    const uint8_t* dist = grid->tile_distance;
+    for(int tx = 0; tx < tx_count; tx++) {
+        for(int ty = 0; ty < ty_count; ty++) {
+            int i = tx * ty_count + ty;
+            int d = dist[i];
+            if(d == 0) continue;
+            if(grid->solid[i]) return 0;
+            if(tx == 0 || ty == 0 || tx == tx_count - 1 || ty == ty_count - 1) {
+                if(d > 1) return 0;
+                continue;
+            }
+            for(int nx = -1; nx <= 1; nx++) {
+                for(int ny = -1; ny <= 1; ny++) {
+                    if(d > dist[i + nx * ty_count + ny] + 1) return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+static int load_map_binary(Map* map, const char* filename) {
+    map->view = map_file_view(map, filename, &map->view_size);
+    if(!map->view) return 0;
+
+    const MapFileHeader* header = map->view;
+    if(!map_header_valid(header, map->view_size)) {
+        unmap_view(map);
+        return 0;
+    }
+
+    uint8_t* base = map->view;
+    map->width = header->width;
+    map->height = header->height;
+    map->grid.tiles_x = header->tiles_x;
+    map->grid.tiles_y = header->tiles_y;
+    map->grid.material = base + header->material_offset;
+    map->grid.solid = (uint64_t*)(base + header->solid_offset);
+    map->grid.tile_distance = base + header->distance_offset;
+    map->spawn = (Camera){header->posX, header->posY, header->dirX, header->dirY,
+                          header->planeX, header->planeY};
+    if(!map_playable(map)) {
+        free_map(map);
+        return 0;
+    }
+    // The mapping is private, so rebuilding a bad plane never touches the file
+    if(map_distance_valid(&map->grid)) map->grid.distance_valid = 1;
+    else map_build_distance(map);
+    return 1;
+}
+
+int load_map(Map* map, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if(!file) return 0;
+    free_map(map);
+
+    char magic[4];
+    int binary = fread(magic, 1, 4, file) == 4 && memcmp(magic, MAP_FILE_MAGIC, 4) == 0;
+    if(binary) {
+        fclose(file);
+        return load_map_binary(map, filename);
+    }
+
+    rewind(file);
+    int loaded = load_map_text(map, file);
+    fclose(file);
+    return loaded;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + 63) & ~(uint64_t)63;
+}
+
+int save_map_binary(Map* map, const char* filename) {
+    const MapGrid* grid = &map->grid;
+    if(!grid->material) return 0;
+    if(!grid->distance_valid) map_build_distance(map);
+
+    uint64_t tiles = (uint64_t)grid->tiles_x * grid->tiles_y;
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_FILE_MAGIC, 4);
+    header.version = MAP_FILE_VERSION;
+    header.width = map->width;
+    header.height = map->height;
+    header.tiles_x = grid->tiles_x;
+    header.tiles_y = grid->tiles_y;
+    header.posX = map->spawn.posX;
+    header.posY = map->spawn.posY;
+    header.dirX = map->spawn.dirX;
+    header.dirY = map->spawn.dirY;
+    header.planeX = map->spawn.planeX;
+    header.planeY = map->spawn.planeY;
+    header.material_offset = align_offset(sizeof(header));
+    header.solid_offset = align_offset(header.material_offset + tiles * MAP_TILE_CELLS);
+    header.distance_offset = align_offset(header.solid_offset + tiles * sizeof(uint64_t));
+    header.file_size = header.distance_offset + tiles + 3;
+
+    FILE* file = fopen(filename, "wb");
+    if(!file) return 0;
+
+    static const uint8_t zeros[64] = {0};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    const struct { uint64_t offset; const void* data; uint64_t size; } planes[] = {
+        {header.material_offset, grid->material, tiles * MAP_TILE_CELLS},
+        {header.solid_offset, grid->solid, tiles * sizeof(uint64_t)},
+        {header.distance_offset, grid->tile_distance, tiles + 3},
+    };
+    for(int i = 0; i < 3 && ok; i++) {
+        ok = fwrite(zeros, 1, planes[i].offset - written, file) == planes[i].offset - written &&
+             fwrite(planes[i].data, 1, planes[i].size, file) == planes[i].size;
+        written = planes[i].offset + planes[i].size;
+    }
+
+    if(fclose(file) != 0) ok = 0;
+    return ok;
+}
+
+#ifndef _WIN32
+// Applies `advice` to the bytes of every plane covering tile rows
+// [tx0, tx1) and tile columns [ty0, ty1). Pages are rounded outwards when
+// prefetching and inwards when releasing, so a release never touches a
+// page shared with a chunk still in use.
+static void advise_tiles(const MapGrid* grid, int tx0, int tx1, int ty0, int ty1, int advice, int outward) {
+    static long page = 0;
+    if(!page) page = sysconf(_SC_PAGESIZE);
+
+    const struct { uint8_t* base; size_t stride; } planes[] = {
+        {grid->material, MAP_TILE_CELLS},
+        {(uint8_t*)grid->solid, sizeof(uint64_t)},
+        {grid->tile_distance, 1},
+    };
+    for(int p = 0; p < 3; p++) {
+        for(int tx = tx0; tx < tx1; tx++) {
+            uintptr_t begin = (uintptr_t)(planes[p].base + ((size_t)tx * grid->tiles_y + ty0) * planes[p].stride);
+            uintptr_t end = (uintptr_t)(planes[p].base + ((size_t)tx * grid->tiles_y + ty1) * planes[p].stride);
+            if(outward) {
+                begin &= ~(uintptr_t)(page - 1);
+                end = (end + page - 1) & ~(uintptr_t)(page - 1);
+            } else {
+                begin = (begin + page - 1) & ~(uintptr_t)(page - 1);
+                end &= ~(uintptr_t)(page - 1);
+            }
+            if(end > begin) madvise((void*)begin, end - begin, advice);
+        }
+    }
+}
+
+static void advise_chunk(const MapGrid* grid, int cx, int cy, int advice, int outward) {
+    int tx0 = cx * MAP_CHUNK_TILES, ty0 = cy * MAP_CHUNK_TILES;
+    int tx1 = tx0 + MAP_CHUNK_TILES, ty1 = ty0 + MAP_CHUNK_TILES;
+    if(tx1 > grid->tiles_x) tx1 = grid->tiles_x;
+    if(ty1 > grid->tiles_y) ty1 = grid->tiles_y;
+    if(tx0 < tx1 && ty0 < ty1) advise_tiles(grid, tx0, tx1, ty0, ty1, advice, outward);
+}
+#endif
+
+// The advice only steers paging, so players sharing a map can stream it
+// concurrently; at worst one marks cold a chunk another is still reading
+void map_stream(const Map* map, MapStreamWindow* window, float x, float y) {
+    if(!map->view) return;
+
+    int cx = ((int)x >> MAP_TILE_SHIFT) / MAP_CHUNK_TILES;
+    int cy = ((int)y >> MAP_TILE_SHIFT) / MAP_CHUNK_TILES;
+    if(cx == window->chunk_x && cy == window->chunk_y) return;
+
+#ifndef _WIN32
+    const MapGrid* grid = &map->grid;
+    int chunks_x = (grid->tiles_x + MAP_CHUNK_TILES - 1) / MAP_CHUNK_TILES;
+    int chunks_y = (grid->tiles_y + MAP_CHUNK_TILES - 1) / MAP_CHUNK_TILES;
+
+#ifdef MADV_COLD
+    // Chunks that left the window become the first to be reclaimed
+    if(window->chunk_x >= 0) {
+        for(int i = window->chunk_x - MAP_STREAM_CHUNKS; i <= window->chunk_x + MAP_STREAM_CHUNKS; i++) {
+            for(int j = window->chunk_y - MAP_STREAM_CHUNKS; j <= window->chunk_y + MAP_STREAM_CHUNKS; j++) {
+                if(i < 0 || j < 0 || i >= chunks_x || j >= chunks_y) continue;
+                if(abs(i - cx) <= MAP_STREAM_CHUNKS && abs(j - cy) <= MAP_STREAM_CHUNKS) continue;
+                advise_chunk(grid, i, j, MADV_COLD, 0);
+            }
+        }
+    }
+#endif
+
+    for(int i = cx - MAP_STREAM_CHUNKS; i <= cx + MAP_STREAM_CHUNKS; i++) {
+        for(int j = cy - MAP_STREAM_CHUNKS; j <= cy + MAP_STREAM_CHUNKS; j++) {
+            if(i < 0 || j < 0 || i >= chunks_x || j >= chunks_y) continue;
+            advise_chunk(grid, i, j, MADV_WILLNEED, 1);
+        }
+    }
+#endif
+
+    window->chunk_x = cx;
+    window->chunk_y = cy;
+}
@@ -1,17 +1,121 @@
-#ifndef MAP_H
-#define MAP_H
-
-#include <stdio.h>
-
-extern int** world_map;
-extern int map_width;
-extern int map_height;
-
-extern float posX, posY;
-extern float dirX, dirY;
-extern float planeX, planeY;
-
-void free_map();
-int load_map(const char* filename);
-
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// The grid is stored in 8x8 cell tiles. A tile's materials fill exactly one
+// 64 byte cache line and its solidity bits one 64 bit word, so a ray or a
+// collision check touching neighbouring cells stays within the same line.
+#define MAP_TILE_SHIFT 3
+#define MAP_TILE_SIZE (1 << MAP_TILE_SHIFT)
+#define MAP_TILE_CELLS (MAP_TILE_SIZE * MAP_TILE_SIZE)
+
+// For empty-space skipping every tile also stores its Chebyshev distance,
+// in tiles, to the nearest tile holding geometry: 0 for such a tile, and
+// otherwise every tile closer than that is known to be empty.
+typedef struct {
+    int tiles_x, tiles_y;   // tiles along x (rows) and y (columns)
+    uint8_t* material;      // one byte per cell, 0 for empty
+    uint64_t* solid;        // one bit per cell, one word per tile
+    uint8_t* tile_distance; // per tile, see above
+    int distance_valid;     // cleared when a cell turns solid
+} MapGrid;
+
+// A player's view: position, facing and the camera plane, whose length
+// sets the field of view
+typedef struct {
+    float posX, posY;
+    float dirX, dirY;
+    float planeX, planeY;
+} Camera;
+
+// A loaded map. Worlds only read it once it is built, so any number of
+// them can share one (see world.h); map_set() and the loaders must not run
+// while a world using the map is being stepped or drawn.
+typedef struct {
+    MapGrid grid;
+    int width, height;
+    Camera spawn;
+    // Set while the grid's planes point into a mapped binary file
+    void* view;
+    size_t view_size;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#endif
+} Map;
+
+// Cells are addressed as (x, y) with x the row of the .map file and y the
+// column, the same way world_map[x][y] used to be
+static inline int map_tile_index(const Map* map, int x, int y) {
+    return (x >> MAP_TILE_SHIFT) * map->grid.tiles_y + (y >> MAP_TILE_SHIFT);
+}
+
+static inline int map_tile_bit(int x, int y) {
+    return ((x & (MAP_TILE_SIZE - 1)) << MAP_TILE_SHIFT) | (y & (MAP_TILE_SIZE - 1));
+}
+
+static inline int map_get(const Map* map, int x, int y) {
+    return map->grid.material[map_tile_index(map, x, y) * MAP_TILE_CELLS + map_tile_bit(x, y)];
+}
+
+static inline int map_is_solid(const Map* map, int x, int y) {
+    return (map->grid.solid[map_tile_index(map, x, y)] >> map_tile_bit(x, y)) & 1;
+}
+
+static inline int map_tile_distance(const Map* map, int x, int y) {
+    return map->grid.tile_distance[map_tile_index(map, x, y)];
+}
+
+// Values are clamped to 0-255; anything above zero is solid
+void map_set(Map* map, int x, int y, int value);
+
+// Rebuilds the tile distance field after the map has been edited
+void map_build_distance(Map* map);
+
+// Binary maps start with this header, followed by the cell planes in
+// exactly the layout MapGrid uses in memory, so loading one is a single
+// mmap with no parsing or copying. Fields are little-endian.
+#define MAP_FILE_MAGIC "RMAP"
+#define MAP_FILE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t tiles_x, tiles_y;
+    float posX, posY;           // player spawn
+    float dirX, dirY;
+    float planeX, planeY;
+    uint64_t material_offset;   // tiles * MAP_TILE_CELLS bytes
+    uint64_t solid_offset;      // tiles 64 bit words
+    uint64_t distance_offset;   // tiles + 3 bytes, see alloc_map()
+    uint64_t file_size;
+    uint8_t reserved[48];
+} MapFileHeader;
+
+// A zeroed Map is empty; free_map() leaves it that way again
+void free_map(Map* map);
+int alloc_map(Map* map, int width, int height);
+// Loads either a text .map or a binary map written by save_map_binary()
+int load_map(Map* map, const char* filename);
+// Writes the map and its player spawn in the binary format
+int save_map_binary(Map* map, const char* filename);
+
+// Streaming for memory-mapped maps: hints the OS to page in the chunks of
+// MAP_CHUNK_TILES x MAP_CHUNK_TILES tiles within MAP_STREAM_CHUNKS of the
+// player and lets chunks that fall out of range be reclaimed. Cells
+// outside the window still load on first touch, so this only moves the
+// page faults off the frame. A no-op for maps loaded from text.
+#define MAP_CHUNK_TILES 8
+#define MAP_STREAM_CHUNKS 2
+
+// Chunk a player's window was last centred on; start it at {-1, -1}
+typedef struct {
+    int chunk_x, chunk_y;
+} MapStreamWindow;
+
+void map_stream(const Map* map, MapStreamWindow* window, float x, float y);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "postfx.h"
+#include "thread_pool.h"
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POSTFX_X86
+#endif
+
+// Pixels per parallel_for tile
+#define POSTFX_TILE_PIXELS 4096
+
+static int blend_factor(float strength) {
+    int a = (int)(strength * 256.0f + 0.5f);
+    return a < 0 ? 0 : (a > 256 ? 256 : a);
+}
+
+static int blend_map(int value, int channel, float strength, const void* params) {
+    uint32_t color = *(const uint32_t*)params;
+    int target = (color >> (16 - 8 * channel)) & 0xFF;
+    int a = blend_factor(strength);
+    return (value * (256 - a) + target * a) >> 8;
+}
+
+static int gamma_map(int value, int channel, float strength, const void* params) {
+    (void)channel;
+    (void)params;
+    return (int)(255.0f * powf(value / 255.0f, 1.0f / strength) + 0.5f);
+}
+
+int postfx_register(PostFx* fx, PostFxMap map, const void* params) {
+    if(fx->pass_count == POSTFX_MAX_PASSES) return -1;
+    fx->passes[fx->pass_count] = (PostFxPass){map, params, 0.0f, 0, 0};
+    fx->fused = 0;
+    return fx->pass_count++;
+}
+
+int postfx_add_blend(PostFx* fx, uint32_t color) {
+    int pass = postfx_register(fx, blend_map, NULL);
+    if(pass < 0) return -1;
+    fx->passes[pass].blend = 1;
+    fx->passes[pass].color = color;
+    fx->passes[pass].params = &fx->passes[pass].color;
+    return pass;
+}
+
+int postfx_add_gamma(PostFx* fx) {
+    return postfx_register(fx, gamma_map, NULL);
+}
+
+void postfx_set_strength(PostFx* fx, int pass, float strength) {
+    if(pass < 0 || pass >= fx->pass_count || fx->passes[pass].strength == strength) return;
+    fx->passes[pass].strength = strength;
+    fx->fused = 0;
+}
+
+float postfx_strength(const PostFx* fx, int pass) {
+    if(pass < 0 || pass >= fx->pass_count) return 0.0f;
+    return fx->passes[pass].strength;
+}
+
+static void fuse_passes(PostFx* fx) {
+    fx->any_active = 0;
+    fx->only_blends = 1;
+    fx->affine_mul = 256;
+    fx->affine_add[0] = fx->affine_add[1] = fx->affine_add[2] = 0;
+
+    // v * mul + add never exceeds 255 * 256: every step is a convex mix
+    for(int i = 0; i < fx->pass_count; i++) {
+        const PostFxPass* pass = &fx->passes[i];
+        if(pass->strength == 0.0f) continue;
+        fx->any_active = 1;
+        if(!pass->blend) {
+            fx->only_blends = 0;
+            continue;
+        }
+        int a = blend_factor(pass->strength);
+        fx->affine_mul = fx->affine_mul * (256 - a) >> 8;
+        for(int c = 0; c < 3; c++) {
+            int target = (pass->color >> (16 - 8 * c)) & 0xFF;
+            fx->affine_add[c] = (fx->affine_add[c] * (256 - a) >> 8) + target * a;
+        }
+    }
+
+    if(fx->any_active && !fx->only_blends) {
+        for(int c = 0; c < 3; c++) {
+            for(int v = 0; v < 256; v++) {
+                int value = v;
+                for(int i = 0; i < fx->pass_count; i++) {
+                    const PostFxPass* pass = &fx->passes[i];
+                    if(pass->strength == 0.0f) continue;
+                    value = pass->map(value, c, pass->strength, pass->params);
+                    value = value < 0 ? 0 : (value > 255 ? 255 : value);
+                }
+                fx->channel_lut[c][v] = (uint32_t)value << (16 - 8 * c);
+            }
+        }
+    }
+    fx->fused = 1;
+}
+
+static void apply_affine(const PostFx* fx, uint32_t* pixels, int count) {
+    int affine_mul = fx->affine_mul;
+    const int* affine_add = fx->affine_add;
+    int i = 0;
+#if defined(__SSE2__)
+    // Two pixels per 16-bit vector, bytes in memory order B, G, R, A
+    __m128i zero = _mm_setzero_si128();
+    __m128i mul = _mm_setr_epi16(affine_mul, affine_mul, affine_mul, 0,
+                                 affine_mul, affine_mul, affine_mul, 0);
+    __m128i add = _mm_setr_epi16((short)affine_add[2], (short)affine_add[1], (short)affine_add[0], 0,
+                                 (short)affine_add[2], (short)affine_add[1], (short)affine_add[0], 0);
+    for(; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(pixels + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), mul), add);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), mul), add);
+        _mm_storeu_si128((__m128i*)(pixels + i),
+            _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+    for(; i < count; i++) {
+        uint32_t p = pixels[i];
+        uint32_t out = 0;
+        for(int c = 0; c < 3; c++) {
+            int shift = 16 - 8 * c;
+            out |= (uint32_t)((((p >> shift) & 0xFF) * affine_mul + affine_add[c]) >> 8) << shift;
+        }
+        pixels[i] = out;
+    }
+}
+
+#ifdef POSTFX_X86
+__attribute__((target("avx2")))
+static void apply_affine_avx2(const PostFx* fx, uint32_t* pixels, int count) {
+    int affine_mul = fx->affine_mul;
+    const int* affine_add = fx->affine_add;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i mul = _mm256_setr_epi16(affine_mul, affine_mul, affine_mul, 0, affine_mul, affine_mul, affine_mul, 0,
+                                    affine_mul, affine_mul, affine_mul, 0, affine_mul, affine_mul, affine_mul, 0);
+    short b = (short)affine_add[2], g = (short)affine_add[1], r = (short)affine_add[0];
+    __m256i add = _mm256_setr_epi16(b, g, r, 0, b, g, r, 0, b, g, r, 0, b, g, r, 0);
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(pixels + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p, zero), mul), add);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p, zero), mul), add);
+        // unpack and pack both work within 128-bit lanes, so order is kept
+        _mm256_storeu_si256((__m256i*)(pixels + i),
+            _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+    apply_affine(fx, pixels + i, count - i);
+}
+#endif
+
+static void apply_lut_scalar(const PostFx* fx, uint32_t* pixels, int count) {
+    const uint32_t (*channel_lut)[256] = fx->channel_lut;
+    for(int i = 0; i < count; i++) {
+        uint32_t p = pixels[i];
+        pixels[i] = channel_lut[0][(p >> 16) & 0xFF] | channel_lut[1][(p >> 8) & 0xFF] | channel_lut[2][p & 0xFF];
+    }
+}
+
+#ifdef POSTFX_X86
+__attribute__((target("avx2")))
+static void apply_lut_avx2(const PostFx* fx, uint32_t* pixels, int count) {
+    const uint32_t (*channel_lut)[256] = fx->channel_lut;
+    __m256i byte = _mm256_set1_epi32(0xFF);
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(pixels + i));
+        __m256i r = _mm256_i32gather_epi32((const int*)channel_lut[0], _mm256_and_si256(_mm256_srli_epi32(p, 16), byte), 4);
+        __m256i g = _mm256_i32gather_epi32((const int*)channel_lut[1], _mm256_and_si256(_mm256_srli_epi32(p, 8), byte), 4);
+        __m256i b = _mm256_i32gather_epi32((const int*)channel_lut[2], _mm256_and_si256(p, byte), 4);
+        _mm256_storeu_si256((__m256i*)(pixels + i), _mm256_or_si256(_mm256_or_si256(r, g), b));
+    }
+    apply_lut_scalar(fx, pixels + i, count - i);
+}
+#endif
+
+typedef struct {
+    const PostFx* fx;
+    uint32_t* pixels;
+    int count;
+    int avx2;
+} PostFxJob;
+
+static void apply_tiles(void* data, int tile_begin, int tile_end) {
+    const PostFxJob* job = data;
+    int begin = tile_begin * POSTFX_TILE_PIXELS;
+    int end = tile_end * POSTFX_TILE_PIXELS;
+    if(end > job->count) end = job->count;
+
+    const PostFx* fx = job->fx;
+    uint32_t* pixels = job->pixels + begin;
+#ifdef POSTFX_X86
+    if(job->avx2) {
+        if(fx->only_blends) apply_affine_avx2(fx, pixels, end - begin);
+        else apply_lut_avx2(fx, pixels, end - begin);
+        return;
+    }
+#endif
+    if(fx->only_blends) apply_affine(fx, pixels, end - begin);
+    else apply_lut_scalar(fx, pixels, end - begin);
+}
+
+void postfx_apply(PostFx* fx, uint32_t* pixels, int count) {
+    if(!fx->fused) fuse_passes(fx);
+    if(!fx->any_active) return;
+
+    PostFxJob job = {fx, pixels, count, 0};
+#ifdef POSTFX_X86
+    __builtin_cpu_init();
+    job.avx2 = __builtin_cpu_supports("avx2");
+#endif
+    int tiles = (count + POSTFX_TILE_PIXELS - 1) / POSTFX_TILE_PIXELS;
+    parallel_for(tiles, 1, apply_tiles, &job);
+}
@@ -0,0 +1,61 @@
+#ifndef POSTFX_H
+#define POSTFX_H
+
+#include <stdint.h>
+
+// Full-screen colour effects. A pass maps each 8-bit channel value on its
+// own, so every active pass fuses into one lookup table per channel and the
+// frame is swept once however many effects are on. When only blends are
+// active (flashes, tints, fades) they fuse further into one multiply-add.
+#define POSTFX_MAX_PASSES 16
+
+// Maps a channel value (channel 0 red, 1 green, 2 blue) at `strength`
+typedef int (*PostFxMap)(int value, int channel, float strength, const void* params);
+
+typedef struct {
+    PostFxMap map;
+    const void* params;
+    float strength;
+    int blend;        // a postfx_add_blend() pass, fusable into the affine form
+    uint32_t color;   // blend target, what `params` points at for blends
+} PostFxPass;
+
+// A chain of passes and its fused form. Each renderer keeps its own; a
+// zeroed one has no passes. Blend passes point into the chain, so it must
+// not be copied once they are added.
+typedef struct {
+    PostFxPass passes[POSTFX_MAX_PASSES];
+    int pass_count;
+
+    // Fused form of the active passes, rebuilt when a strength changes.
+    // With only blends active each channel is
+    // (v * affine_mul + affine_add[c]) >> 8; otherwise the lookup tables
+    // hold every channel's final value already shifted into place, so a
+    // pixel is three loads and two ORs.
+    int fused;
+    int any_active;
+    int only_blends;
+    int affine_mul;
+    int affine_add[3];
+    uint32_t channel_lut[3][256];
+} PostFx;
+
+// Registers a pass, applied after every pass registered before it.
+// Passes start inactive, at strength 0. Returns the pass id, or -1 when
+// all POSTFX_MAX_PASSES are taken.
+int postfx_register(PostFx* fx, PostFxMap map, const void* params);
+// Blend towards `color`; strength is the blend factor, 0 to 1
+int postfx_add_blend(PostFx* fx, uint32_t color);
+// Gamma correction; strength is the gamma, 1 leaving the frame unchanged
+int postfx_add_gamma(PostFx* fx);
+
+// Strength 0 turns a pass off
+void postfx_set_strength(PostFx* fx, int pass, float strength);
+float postfx_strength(const PostFx* fx, int pass);
+
+// Runs every active pass over `count` pixels in one sweep, split across
+// the thread pool; returns at once when no pass is active. Alpha is
+// cleared.
+void postfx_apply(PostFx* fx, uint32_t* pixels, int count);
+
+#endif
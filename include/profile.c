@@ -0,0 +1,223 @@
+#include "profile.h"
+
+#ifdef PROFILE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_RING_EVENTS 65536    // per thread, a power of two
+#define PROFILE_MAX_DEPTH 16
+#define PROFILE_FRAME_HISTORY 4096   // frames of counters kept for the trace
+
+static const char* zone_names[ZONE_COUNT] = {
+    "frame", "walls", "floor", "entities", "ui", "weapon", "postfx", "upload", "tick", "entity update"
+};
+
+static const char* counter_names[COUNTER_COUNT] = {
+    "dda steps", "pixels", "sprite pixels", "sorted"
+};
+
+typedef struct {
+    uint64_t begin, end;    // ns
+    int zone;
+} ProfileEvent;
+
+// Written by its own thread only; others just read
+typedef struct {
+    int id;
+    ProfileEvent* events;
+    uint64_t written;       // events ever written; the ring holds the last ones
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t zone_ns[ZONE_COUNT];
+    uint64_t open_begin[PROFILE_MAX_DEPTH];
+    int depth;
+} ProfileThread;
+
+static ProfileThread* threads[PROFILE_MAX_THREADS];
+static int thread_count = 0;
+static _Thread_local ProfileThread* current = NULL;
+// Counters for threads that found every slot taken; never read
+static _Thread_local uint64_t spare_counters[COUNTER_COUNT];
+
+// Totals as of the last profile_frame_end(), and the frame they closed
+static uint64_t previous_counters[COUNTER_COUNT];
+static uint64_t previous_zone_ns[ZONE_COUNT];
+static uint64_t frame_counters[COUNTER_COUNT];
+static uint64_t frame_zone_ns[ZONE_COUNT];
+
+typedef struct {
+    uint64_t time;
+    uint64_t counters[COUNTER_COUNT];
+} ProfileFrame;
+
+static ProfileFrame frames[PROFILE_FRAME_HISTORY];
+static uint64_t frames_written = 0;
+
+static int overlay_enabled = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// This thread's state, registered on first use. Slots are claimed with an
+// atomic increment and published with a release store, so readers see
+// either nothing or a complete thread.
+static ProfileThread* this_thread() {
+    if(current) return current;
+    int id = __atomic_fetch_add(&thread_count, 1, __ATOMIC_RELAXED);
+    if(id >= PROFILE_MAX_THREADS) return NULL;
+    ProfileThread* thread = calloc(1, sizeof(ProfileThread));
+    if(thread) thread->events = malloc(PROFILE_RING_EVENTS * sizeof(ProfileEvent));
+    if(!thread || !thread->events) {
+        free(thread);
+        return NULL;
+    }
+    thread->id = id;
+    current = thread;
+    __atomic_store_n(&threads[id], thread, __ATOMIC_RELEASE);
+    return thread;
+}
+
+void profile_begin(int zone) {
+    (void)zone;
+    ProfileThread* thread = this_thread();
+    if(!thread) return;
+    if(thread->depth < PROFILE_MAX_DEPTH) thread->open_begin[thread->depth] = now_ns();
+    thread->depth++;
+}
+
+void profile_end(int zone) {
+    ProfileThread* thread = this_thread();
+    if(!thread || thread->depth == 0) return;
+    if(--thread->depth >= PROFILE_MAX_DEPTH) return;
+
+    uint64_t begin = thread->open_begin[thread->depth];
+    uint64_t end = now_ns();
+    ProfileEvent* event = &thread->events[thread->written & (PROFILE_RING_EVENTS - 1)];
+    event->begin = begin;
+    event->end = end;
+    event->zone = zone;
+    __atomic_store_n(&thread->zone_ns[zone], thread->zone_ns[zone] + (end - begin), __ATOMIC_RELAXED);
+    __atomic_store_n(&thread->written, thread->written + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t* profile_counters() {
+    ProfileThread* thread = this_thread();
+    return thread ? thread->counters : spare_counters;
+}
+
+void profile_frame_end() {
+    uint64_t counters[COUNTER_COUNT] = {0};
+    uint64_t zone_ns[ZONE_COUNT] = {0};
+    int count = __atomic_load_n(&thread_count, __ATOMIC_RELAXED);
+    if(count > PROFILE_MAX_THREADS) count = PROFILE_MAX_THREADS;
+    for(int t = 0; t < count; t++) {
+        ProfileThread* thread = __atomic_load_n(&threads[t], __ATOMIC_ACQUIRE);
+        if(!thread) continue;
+        for(int c = 0; c < COUNTER_COUNT; c++) counters[c] += __atomic_load_n(&thread->counters[c], __ATOMIC_RELAXED);
+        for(int z = 0; z < ZONE_COUNT; z++) zone_ns[z] += __atomic_load_n(&thread->zone_ns[z], __ATOMIC_RELAXED);
+    }
+
+    ProfileFrame* frame = &frames[frames_written % PROFILE_FRAME_HISTORY];
+    frame->time = now_ns();
+    for(int c = 0; c < COUNTER_COUNT; c++) {
+        frame_counters[c] = frame->counters[c] = counters[c] - previous_counters[c];
+        previous_counters[c] = counters[c];
+    }
+    for(int z = 0; z < ZONE_COUNT; z++) {
+        frame_zone_ns[z] = zone_ns[z] - previous_zone_ns[z];
+        previous_zone_ns[z] = zone_ns[z];
+    }
+    frames_written++;
+}
+
+uint64_t profile_frame_counter(int counter) {
+    return frame_counters[counter];
+}
+
+double profile_frame_ms(int zone) {
+    return frame_zone_ns[zone] / 1e6;
+}
+
+// Copies out the events of one thread still in its ring. Events the
+// writer may have overwritten while they were copied are dropped.
+static uint64_t copy_events(ProfileThread* thread, ProfileEvent* out, uint64_t* first) {
+    uint64_t end = __atomic_load_n(&thread->written, __ATOMIC_ACQUIRE);
+    uint64_t begin = end > PROFILE_RING_EVENTS ? end - PROFILE_RING_EVENTS : 0;
+    for(uint64_t i = begin; i < end; i++) out[i - begin] = thread->events[i & (PROFILE_RING_EVENTS - 1)];
+    // The writer may be filling slot `now` already, which held event
+    // now - PROFILE_RING_EVENTS
+    uint64_t now = __atomic_load_n(&thread->written, __ATOMIC_ACQUIRE);
+    uint64_t safe = now + 1 > PROFILE_RING_EVENTS ? now + 1 - PROFILE_RING_EVENTS : 0;
+    *first = safe > begin ? (safe - begin < end - begin ? safe - begin : end - begin) : 0;
+    return end - begin;
+}
+
+int profile_write_trace(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    ProfileEvent* events = malloc(PROFILE_RING_EVENTS * sizeof(ProfileEvent));
+    if(!file || !events) {
+        if(file) fclose(file);
+        free(events);
+        return 0;
+    }
+
+    // Chrome trace timestamps are microseconds
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first_line = 1;
+    int count = __atomic_load_n(&thread_count, __ATOMIC_RELAXED);
+    if(count > PROFILE_MAX_THREADS) count = PROFILE_MAX_THREADS;
+    for(int t = 0; t < count; t++) {
+        ProfileThread* thread = __atomic_load_n(&threads[t], __ATOMIC_ACQUIRE);
+        if(!thread) continue;
+        uint64_t first;
+        uint64_t n = copy_events(thread, events, &first);
+        for(uint64_t i = first; i < n; i++) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first_line ? "" : ",\n", zone_names[events[i].zone], thread->id,
+                    events[i].begin / 1e3, (events[i].end - events[i].begin) / 1e3);
+            first_line = 0;
+        }
+    }
+
+    uint64_t begin = frames_written > PROFILE_FRAME_HISTORY ? frames_written - PROFILE_FRAME_HISTORY : 0;
+    for(uint64_t f = begin; f < frames_written; f++) {
+        const ProfileFrame* frame = &frames[f % PROFILE_FRAME_HISTORY];
+        for(int c = 0; c < COUNTER_COUNT; c++) {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+                    first_line ? "" : ",\n", counter_names[c], frame->time / 1e3,
+                    (unsigned long long)frame->counters[c]);
+            first_line = 0;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    free(events);
+    return fclose(file) == 0;
+}
+
+void profile_set_overlay(int enabled) {
+    overlay_enabled = enabled;
+}
+
+void profile_draw_overlay(Surface* target) {
+    if(!overlay_enabled) return;
+    char line[64];
+    int y = 4;
+    for(int z = 0; z < ZONE_COUNT; z++) {
+        if(frame_zone_ns[z] == 0) continue;
+        snprintf(line, sizeof(line), "%-13s %6.2f ms", zone_names[z], profile_frame_ms(z));
+        draw_string(target, 4, y, line, 0xFFFF00);
+        y += 10;
+    }
+    for(int c = 0; c < COUNTER_COUNT; c++) {
+        snprintf(line, sizeof(line), "%-13s %8llu", counter_names[c], (unsigned long long)frame_counters[c]);
+        draw_string(target, 4, y, line, 0x00FFFF);
+        y += 10;
+    }
+}
+
+#endif
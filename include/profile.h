@@ -0,0 +1,79 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "graphic.h"
+
+// Frame instrumentation: timed zones and counters, built in only with
+// -DPROFILE (make ... PROFILE=1). Otherwise every macro and function below
+// compiles to nothing.
+//
+// Each thread records into its own ring, so recording takes no locks and
+// never waits; a full ring overwrites its oldest zones. Counters are
+// per-thread running totals, read as per-frame deltas at
+// profile_frame_end().
+enum PROFILE_ZONES {
+    ZONE_FRAME,         // render_scene() as a whole
+    ZONE_WALLS,
+    ZONE_FLOOR,
+    ZONE_ENTITIES,
+    ZONE_UI,
+    ZONE_WEAPON,
+    ZONE_POSTFX,
+    ZONE_UPLOAD,        // texture upload and present
+    ZONE_TICK,          // world_tick()
+    ZONE_ENTITY_UPDATE,
+    ZONE_COUNT
+};
+
+enum PROFILE_COUNTERS {
+    COUNTER_DDA_STEPS,      // cells stepped by wall rays, per lane
+    COUNTER_PIXELS,         // pixels written by the wall, floor, sprite and HUD passes
+    COUNTER_SPRITE_PIXELS,  // of those, sprite pixels: overdraw on the scene
+    COUNTER_SORTED,         // entities sorted for drawing
+    COUNTER_COUNT
+};
+
+#ifdef PROFILE
+
+// Zones on one thread must nest
+#define PROFILE_BEGIN(zone) profile_begin(zone)
+#define PROFILE_END(zone) profile_end(zone)
+#define PROFILE_COUNT(counter, n) (profile_counters()[counter] += (uint64_t)(n))
+
+void profile_begin(int zone);
+void profile_end(int zone);
+// This thread's running counter totals
+uint64_t* profile_counters();
+
+// Closes a frame: the counters since the previous call become the frame's
+// values. Call it from one thread, between frames.
+void profile_frame_end();
+// The last closed frame's counter values and zone times
+uint64_t profile_frame_counter(int counter);
+double profile_frame_ms(int zone);
+
+// Writes the recorded zones, and counters per frame, as a Chrome trace
+// (chrome://tracing or Perfetto); 0 on failure
+int profile_write_trace(const char* filename);
+
+// The last frame's numbers over the top left of `target`
+void profile_set_overlay(int enabled);
+void profile_draw_overlay(Surface* target);
+
+#else
+
+#define PROFILE_BEGIN(zone) ((void)0)
+#define PROFILE_END(zone) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+
+static inline void profile_frame_end() {}
+static inline uint64_t profile_frame_counter(int counter) { (void)counter; return 0; }
+static inline double profile_frame_ms(int zone) { (void)zone; return 0.0; }
+static inline int profile_write_trace(const char* filename) { (void)filename; return 0; }
+static inline void profile_set_overlay(int enabled) { (void)enabled; }
+static inline void profile_draw_overlay(Surface* target) { (void)target; }
+
+#endif
+
+#endif
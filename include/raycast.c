@@ -0,0 +1,537 @@
+#include "raycast.h"
+#include "graphic.h"
+#include "map.h"
+#include "profile.h"
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAYCAST_X86 1
+#include <immintrin.h>
+#endif
+
+// Resolved on first use by whichever thread gets there; every thread
+// detects the same value, so racing stores are harmless once atomic
+static int selected_isa = -1;
+static int skip_enabled = 1;
+
+float fast_inv_sqrt(float x) {
+    union { float f; uint32_t i; } conv = {x};
+    conv.i = 0x5f3759df - (conv.i >> 1);
+    conv.f *= 1.5f - (x * 0.5f * conv.f * conv.f);
+    return conv.f;
+}
+
+// Radius, in tiles, of the empty square of tiles centred on the cell's
+// tile; 0 when the ray has to step cell by cell
+static int empty_radius(const Map* map, int x, int y) {
+    return map_tile_distance(map, x, y);
+}
+
+// Moves the DDA state straight to the first cell past the empty square of
+// tiles within `radius` - 1 of the one holding (mapX, mapY). The steps the
+// cell-by-cell loop would have taken inside are counted in closed form, so
+// its outcome is the same apart from rounding on rays passing exactly
+// through a cell corner.
+static void skip_empty(int radius, int* mapX, int* mapY, float* sideDistX, float* sideDistY,
+                       float deltaDistX, float deltaDistY, int stepX, int stepY, int* side) {
+    int reach = (radius - 1) << MAP_TILE_SHIFT;
+    int lowX = ((*mapX >> MAP_TILE_SHIFT) << MAP_TILE_SHIFT) - reach;
+    int lowY = ((*mapY >> MAP_TILE_SHIFT) << MAP_TILE_SHIFT) - reach;
+    int size = 2 * reach + MAP_TILE_SIZE;
+    int stepsX = stepX > 0 ? lowX + size - *mapX : *mapX - lowX + 1;
+    int stepsY = stepY > 0 ? lowY + size - *mapY : *mapY - lowY + 1;
+
+    // Distance along the ray at which each axis leaves the square
+    float exitX = stepsX > 1 ? *sideDistX + (stepsX - 1) * deltaDistX : *sideDistX;
+    float exitY = stepsY > 1 ? *sideDistY + (stepsY - 1) * deltaDistY : *sideDistY;
+
+    int movesX, movesY;
+    if(exitX < exitY) {
+        // Leaves through an x-side; count the y-steps taken on the way
+        movesX = stepsX;
+        movesY = 0;
+        if(exitX >= *sideDistY) {
+            movesY = (int)((exitX - *sideDistY) / deltaDistY) + 1;
+            if(movesY > stepsY - 1) movesY = stepsY - 1;
+        }
+        *side = 0;
+    } else {
+        movesY = stepsY;
+        movesX = 0;
+        if(*sideDistX < exitY) {
+            float steps = (exitY - *sideDistX) / deltaDistX;
+            movesX = (int)steps;
+            if(movesX < steps) movesX++;
+            if(movesX > stepsX - 1) movesX = stepsX - 1;
+        }
+        *side = 1;
+    }
+
+    if(movesX > 0) {
+        *mapX += movesX * stepX;
+        *sideDistX += movesX * deltaDistX;
+    }
+    if(movesY > 0) {
+        *mapY += movesY * stepY;
+        *sideDistY += movesY * deltaDistY;
+    }
+}
+
+static void cast_ray_scalar(const Map* map, const Camera* camera, int x, int columns, float limit, RayHit* hit_out) {
+    float posX = camera->posX, posY = camera->posY;
+    float dirX = camera->dirX, dirY = camera->dirY;
+    float planeX = camera->planeX, planeY = camera->planeY;
+
+    // Raycasting calculations
+    float cameraX = 2 * x / (float)columns - 1;
+    float rayDirX = dirX + planeX * cameraX;
+    float rayDirY = dirY + planeY * cameraX;
+
+    // Normalize ray direction
+    float len_sq = rayDirX*rayDirX + rayDirY*rayDirY;
+    float inv_len = fast_inv_sqrt(len_sq);
+    rayDirX *= inv_len;
+    rayDirY *= inv_len;
+
+    // DDA algorithm
+    int mapX = (int)posX;
+    int mapY = (int)posY;
+    float deltaDistX = fabsf(1 / rayDirX);
+    float deltaDistY = fabsf(1 / rayDirY);
+
+    float sideDistX, sideDistY;
+    int stepX, stepY;
+    int hit = 0, side = 0;
+    int skipping = skip_enabled && map->grid.distance_valid;
+
+    if(rayDirX < 0) {
+        stepX = -1;
+        sideDistX = (posX - mapX) * deltaDistX;
+    } else {
+        stepX = 1;
+        sideDistX = (mapX + 1.0f - posX) * deltaDistX;
+    }
+    if(rayDirY < 0) {
+        stepY = -1;
+        sideDistY = (posY - mapY) * deltaDistY;
+    } else {
+        stepY = 1;
+        sideDistY = (mapY + 1.0f - posY) * deltaDistY;
+    }
+
+    while(!hit) {
+        // The next cell starts beyond the distance limit
+        if((sideDistX < sideDistY ? sideDistX : sideDistY) > limit) {
+            side = RAY_MISS;
+            break;
+        }
+        PROFILE_COUNT(COUNTER_DDA_STEPS, 1);
+        int radius = skipping ? empty_radius(map, mapX, mapY) : 0;
+        if(radius) {
+            skip_empty(radius, &mapX, &mapY, &sideDistX, &sideDistY,
+                       deltaDistX, deltaDistY, stepX, stepY, &side);
+        } else if(sideDistX < sideDistY) {
+            sideDistX += deltaDistX;
+            mapX += stepX;
+            side = 0;
+        } else {
+            sideDistY += deltaDistY;
+            mapY += stepY;
+            side = 1;
+        }
+        if(map_is_solid(map, mapX, mapY)) hit = 1;
+    }
+
+    hit_out->rayDirX = rayDirX;
+    hit_out->rayDirY = rayDirY;
+    hit_out->mapX = mapX;
+    hit_out->mapY = mapY;
+    hit_out->stepX = stepX;
+    hit_out->stepY = stepY;
+    hit_out->side = side;
+}
+
+#ifdef RAYCAST_X86
+// Packet versions of cast_ray_scalar(). Lanes are adjacent columns walking
+// the DDA in lockstep; a lane drops out of the active mask once it hits and
+// the packet finishes when every lane has. The float operations are the
+// same ones, in the same order, as the scalar path (no FMA), so the hits
+// match it bit for bit. Lanes sitting in an empty tile take the scalar
+// skip_empty() jump instead of a step, exactly as the scalar loop does.
+
+// Applies skip_empty() to the lanes set in `jump`. The lane state is passed
+// as spilled arrays; the callers reload their vectors afterwards.
+static void skip_lanes(const Map* map, int jump, int lanes, int* mapX, int* mapY, float* sideDistX, float* sideDistY,
+                       const float* deltaDistX, const float* deltaDistY,
+                       const int* stepX, const int* stepY, int* side) {
+    for(int i = 0; i < lanes; i++) {
+        if(!(jump >> i & 1)) continue;
+        skip_empty(empty_radius(map, mapX[i], mapY[i]), &mapX[i], &mapY[i],
+                   &sideDistX[i], &sideDistY[i], deltaDistX[i], deltaDistY[i],
+                   stepX[i], stepY[i], &side[i]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void cast_packet_sse(const Map* map, const Camera* camera, int x, int columns, float limit, RayHit* hits) {
+    float posX = camera->posX, posY = camera->posY;
+    float dirX = camera->dirX, dirY = camera->dirY;
+    float planeX = camera->planeX, planeY = camera->planeY;
+    __m128 cameraX = _mm_sub_ps(
+        _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(2 * x, 2 * x + 2, 2 * x + 4, 2 * x + 6)),
+                   _mm_set1_ps((float)columns)),
+        _mm_set1_ps(1.0f));
+    __m128 rayDirX = _mm_add_ps(_mm_set1_ps(dirX), _mm_mul_ps(_mm_set1_ps(planeX), cameraX));
+    __m128 rayDirY = _mm_add_ps(_mm_set1_ps(dirY), _mm_mul_ps(_mm_set1_ps(planeY), cameraX));
+
+    __m128 len_sq = _mm_add_ps(_mm_mul_ps(rayDirX, rayDirX), _mm_mul_ps(rayDirY, rayDirY));
+    __m128 inv_len = _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32(0x5f3759df),
+        _mm_srli_epi32(_mm_castps_si128(len_sq), 1)));
+    __m128 refine = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(len_sq, _mm_set1_ps(0.5f)), inv_len), inv_len);
+    inv_len = _mm_mul_ps(inv_len, _mm_sub_ps(_mm_set1_ps(1.5f), refine));
+    rayDirX = _mm_mul_ps(rayDirX, inv_len);
+    rayDirY = _mm_mul_ps(rayDirY, inv_len);
+
+    int cellX = (int)posX;
+    int cellY = (int)posY;
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 deltaDistX = _mm_andnot_ps(sign, _mm_div_ps(one, rayDirX));
+    __m128 deltaDistY = _mm_andnot_ps(sign, _mm_div_ps(one, rayDirY));
+
+    __m128 negX = _mm_cmplt_ps(rayDirX, _mm_setzero_ps());
+    __m128 negY = _mm_cmplt_ps(rayDirY, _mm_setzero_ps());
+    __m128 fromX = _mm_or_ps(_mm_and_ps(negX, _mm_set1_ps(posX - cellX)),
+                             _mm_andnot_ps(negX, _mm_set1_ps(cellX + 1.0f - posX)));
+    __m128 fromY = _mm_or_ps(_mm_and_ps(negY, _mm_set1_ps(posY - cellY)),
+                             _mm_andnot_ps(negY, _mm_set1_ps(cellY + 1.0f - posY)));
+    __m128 sideDistX = _mm_mul_ps(fromX, deltaDistX);
+    __m128 sideDistY = _mm_mul_ps(fromY, deltaDistY);
+
+    // -1 where the ray points backwards, +1 otherwise
+    __m128i stepX = _mm_or_si128(_mm_castps_si128(negX), _mm_set1_epi32(1));
+    __m128i stepY = _mm_or_si128(_mm_castps_si128(negY), _mm_set1_epi32(1));
+    __m128i mapX = _mm_set1_epi32(cellX);
+    __m128i mapY = _mm_set1_epi32(cellY);
+    __m128i side = _mm_setzero_si128();
+    __m128i active = _mm_set1_epi32(-1);
+    int skipping = skip_enabled && map->grid.distance_valid;
+
+    int lanesX[4], lanesY[4];
+    while(_mm_movemask_ps(_mm_castsi128_ps(active))) {
+        __m128i far = _mm_and_si128(active, _mm_castps_si128(
+            _mm_cmpgt_ps(_mm_min_ps(sideDistX, sideDistY), _mm_set1_ps(limit))));
+        side = _mm_or_si128(_mm_andnot_si128(far, side), _mm_and_si128(far, _mm_set1_epi32(RAY_MISS)));
+        active = _mm_andnot_si128(far, active);
+        if(!_mm_movemask_ps(_mm_castsi128_ps(active))) break;
+        PROFILE_COUNT(COUNTER_DDA_STEPS, __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(active))));
+
+        __m128i stepping = active;
+        if(skipping) {
+            _mm_storeu_si128((__m128i*)lanesX, mapX);
+            _mm_storeu_si128((__m128i*)lanesY, mapY);
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(active));
+            int jump = 0;
+            for(int i = 0; i < 4; i++) {
+                if((mask >> i & 1) && empty_radius(map, lanesX[i], lanesY[i])) jump |= 1 << i;
+            }
+            if(jump) {
+                float sdX[4], sdY[4], ddX[4], ddY[4];
+                int stX[4], stY[4], sides[4];
+                _mm_storeu_ps(sdX, sideDistX);
+                _mm_storeu_ps(sdY, sideDistY);
+                _mm_storeu_ps(ddX, deltaDistX);
+                _mm_storeu_ps(ddY, deltaDistY);
+                _mm_storeu_si128((__m128i*)stX, stepX);
+                _mm_storeu_si128((__m128i*)stY, stepY);
+                _mm_storeu_si128((__m128i*)sides, side);
+                skip_lanes(map, jump, 4, lanesX, lanesY, sdX, sdY, ddX, ddY, stX, stY, sides);
+                mapX = _mm_loadu_si128((__m128i*)lanesX);
+                mapY = _mm_loadu_si128((__m128i*)lanesY);
+                sideDistX = _mm_loadu_ps(sdX);
+                sideDistY = _mm_loadu_ps(sdY);
+                side = _mm_loadu_si128((__m128i*)sides);
+                __m128i jumped = _mm_setr_epi32(-(jump & 1), -(jump >> 1 & 1),
+                                                -(jump >> 2 & 1), -(jump >> 3 & 1));
+                stepping = _mm_andnot_si128(jumped, active);
+            }
+        }
+
+        __m128i takeX = _mm_and_si128(stepping, _mm_castps_si128(_mm_cmplt_ps(sideDistX, sideDistY)));
+        __m128i takeY = _mm_andnot_si128(takeX, stepping);
+
+        sideDistX = _mm_add_ps(sideDistX, _mm_and_ps(_mm_castsi128_ps(takeX), deltaDistX));
+        sideDistY = _mm_add_ps(sideDistY, _mm_and_ps(_mm_castsi128_ps(takeY), deltaDistY));
+        mapX = _mm_add_epi32(mapX, _mm_and_si128(takeX, stepX));
+        mapY = _mm_add_epi32(mapY, _mm_and_si128(takeY, stepY));
+        side = _mm_or_si128(_mm_andnot_si128(stepping, side),
+                            _mm_and_si128(takeY, _mm_set1_epi32(1)));
+
+        _mm_storeu_si128((__m128i*)lanesX, mapX);
+        _mm_storeu_si128((__m128i*)lanesY, mapY);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(active));
+        int hit_lanes[4];
+        for(int i = 0; i < 4; i++) {
+            hit_lanes[i] = (mask >> i & 1) && map_is_solid(map, lanesX[i], lanesY[i]) ? -1 : 0;
+        }
+        active = _mm_andnot_si128(_mm_loadu_si128((__m128i*)hit_lanes), active);
+    }
+
+    float dirsX[4], dirsY[4];
+    int steps_x[4], steps_y[4], sides[4];
+    _mm_storeu_ps(dirsX, rayDirX);
+    _mm_storeu_ps(dirsY, rayDirY);
+    _mm_storeu_si128((__m128i*)lanesX, mapX);
+    _mm_storeu_si128((__m128i*)lanesY, mapY);
+    _mm_storeu_si128((__m128i*)steps_x, stepX);
+    _mm_storeu_si128((__m128i*)steps_y, stepY);
+    _mm_storeu_si128((__m128i*)sides, side);
+    for(int i = 0; i < 4; i++) {
+        hits[i] = (RayHit){dirsX[i], dirsY[i], lanesX[i], lanesY[i],
+                           steps_x[i], steps_y[i], sides[i]};
+    }
+}
+
+// skip_empty() across eight lanes at once, for the lanes set in `jump`.
+// Same operations as the scalar version, including the truncating float to
+// int conversions, so the two agree exactly.
+__attribute__((target("avx2")))
+static void skip_empty_avx2(__m256i jump, __m256i radius, __m256i* mapX, __m256i* mapY,
+                            __m256* sideDistX, __m256* sideDistY, __m256 deltaDistX, __m256 deltaDistY,
+                            __m256i stepX, __m256i stepY, __m256i* side) {
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i reach = _mm256_slli_epi32(_mm256_sub_epi32(radius, one), MAP_TILE_SHIFT);
+    __m256i lowX = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_srli_epi32(*mapX, MAP_TILE_SHIFT), MAP_TILE_SHIFT), reach);
+    __m256i lowY = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_srli_epi32(*mapY, MAP_TILE_SHIFT), MAP_TILE_SHIFT), reach);
+    __m256i size = _mm256_add_epi32(_mm256_slli_epi32(reach, 1), _mm256_set1_epi32(MAP_TILE_SIZE));
+
+    __m256i stepsX = _mm256_blendv_epi8(_mm256_sub_epi32(_mm256_add_epi32(lowX, size), *mapX),
+        _mm256_add_epi32(_mm256_sub_epi32(*mapX, lowX), one), _mm256_cmpgt_epi32(zero, stepX));
+    __m256i stepsY = _mm256_blendv_epi8(_mm256_sub_epi32(_mm256_add_epi32(lowY, size), *mapY),
+        _mm256_add_epi32(_mm256_sub_epi32(*mapY, lowY), one), _mm256_cmpgt_epi32(zero, stepY));
+    __m256i lastX = _mm256_sub_epi32(stepsX, one);
+    __m256i lastY = _mm256_sub_epi32(stepsY, one);
+
+    __m256 exitX = _mm256_blendv_ps(*sideDistX,
+        _mm256_add_ps(*sideDistX, _mm256_mul_ps(_mm256_cvtepi32_ps(lastX), deltaDistX)),
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(stepsX, one)));
+    __m256 exitY = _mm256_blendv_ps(*sideDistY,
+        _mm256_add_ps(*sideDistY, _mm256_mul_ps(_mm256_cvtepi32_ps(lastY), deltaDistY)),
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(stepsY, one)));
+    __m256i xFirst = _mm256_castps_si256(_mm256_cmp_ps(exitX, exitY, _CMP_LT_OQ));
+
+    // y-steps on the way out through an x-side
+    __m256i crossY = _mm256_add_epi32(one, _mm256_cvttps_epi32(
+        _mm256_div_ps(_mm256_sub_ps(exitX, *sideDistY), deltaDistY)));
+    crossY = _mm256_and_si256(_mm256_min_epi32(crossY, lastY),
+        _mm256_castps_si256(_mm256_cmp_ps(exitX, *sideDistY, _CMP_GE_OQ)));
+
+    // x-steps on the way out through a y-side, rounded up
+    __m256 stepsToExit = _mm256_div_ps(_mm256_sub_ps(exitY, *sideDistX), deltaDistX);
+    __m256i crossX = _mm256_cvttps_epi32(stepsToExit);
+    crossX = _mm256_sub_epi32(crossX,
+        _mm256_castps_si256(_mm256_cmp_ps(_mm256_cvtepi32_ps(crossX), stepsToExit, _CMP_LT_OQ)));
+    crossX = _mm256_and_si256(_mm256_min_epi32(crossX, lastX),
+        _mm256_castps_si256(_mm256_cmp_ps(*sideDistX, exitY, _CMP_LT_OQ)));
+
+    __m256i movesX = _mm256_and_si256(jump, _mm256_blendv_epi8(crossX, stepsX, xFirst));
+    __m256i movesY = _mm256_and_si256(jump, _mm256_blendv_epi8(stepsY, crossY, xFirst));
+    __m256i moveX = _mm256_cmpgt_epi32(movesX, zero);
+    __m256i moveY = _mm256_cmpgt_epi32(movesY, zero);
+
+    *mapX = _mm256_add_epi32(*mapX, _mm256_and_si256(moveX, _mm256_mullo_epi32(movesX, stepX)));
+    *mapY = _mm256_add_epi32(*mapY, _mm256_and_si256(moveY, _mm256_mullo_epi32(movesY, stepY)));
+    *sideDistX = _mm256_blendv_ps(*sideDistX,
+        _mm256_add_ps(*sideDistX, _mm256_mul_ps(_mm256_cvtepi32_ps(movesX), deltaDistX)),
+        _mm256_castsi256_ps(moveX));
+    *sideDistY = _mm256_blendv_ps(*sideDistY,
+        _mm256_add_ps(*sideDistY, _mm256_mul_ps(_mm256_cvtepi32_ps(movesY), deltaDistY)),
+        _mm256_castsi256_ps(moveY));
+    *side = _mm256_blendv_epi8(*side, _mm256_andnot_si256(xFirst, one), jump);
+}
+
+__attribute__((target("avx2")))
+static void cast_packet_avx2(const Map* map, const Camera* camera, int x, int columns, float limit, RayHit* hits) {
+    float posX = camera->posX, posY = camera->posY;
+    float dirX = camera->dirX, dirY = camera->dirY;
+    float planeX = camera->planeX, planeY = camera->planeY;
+    __m256i lane = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    __m256 cameraX = _mm256_sub_ps(
+        _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(2 * x), lane)),
+                      _mm256_set1_ps((float)columns)),
+        _mm256_set1_ps(1.0f));
+    __m256 rayDirX = _mm256_add_ps(_mm256_set1_ps(dirX), _mm256_mul_ps(_mm256_set1_ps(planeX), cameraX));
+    __m256 rayDirY = _mm256_add_ps(_mm256_set1_ps(dirY), _mm256_mul_ps(_mm256_set1_ps(planeY), cameraX));
+
+    __m256 len_sq = _mm256_add_ps(_mm256_mul_ps(rayDirX, rayDirX), _mm256_mul_ps(rayDirY, rayDirY));
+    __m256 inv_len = _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_set1_epi32(0x5f3759df),
+        _mm256_srli_epi32(_mm256_castps_si256(len_sq), 1)));
+    __m256 refine = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(len_sq, _mm256_set1_ps(0.5f)), inv_len), inv_len);
+    inv_len = _mm256_mul_ps(inv_len, _mm256_sub_ps(_mm256_set1_ps(1.5f), refine));
+    rayDirX = _mm256_mul_ps(rayDirX, inv_len);
+    rayDirY = _mm256_mul_ps(rayDirY, inv_len);
+
+    int cellX = (int)posX;
+    int cellY = (int)posY;
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 deltaDistX = _mm256_andnot_ps(sign, _mm256_div_ps(one, rayDirX));
+    __m256 deltaDistY = _mm256_andnot_ps(sign, _mm256_div_ps(one, rayDirY));
+
+    __m256 negX = _mm256_cmp_ps(rayDirX, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256 negY = _mm256_cmp_ps(rayDirY, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256 fromX = _mm256_blendv_ps(_mm256_set1_ps(cellX + 1.0f - posX), _mm256_set1_ps(posX - cellX), negX);
+    __m256 fromY = _mm256_blendv_ps(_mm256_set1_ps(cellY + 1.0f - posY), _mm256_set1_ps(posY - cellY), negY);
+    __m256 sideDistX = _mm256_mul_ps(fromX, deltaDistX);
+    __m256 sideDistY = _mm256_mul_ps(fromY, deltaDistY);
+
+    __m256i stepX = _mm256_or_si256(_mm256_castps_si256(negX), _mm256_set1_epi32(1));
+    __m256i stepY = _mm256_or_si256(_mm256_castps_si256(negY), _mm256_set1_epi32(1));
+    __m256i mapX = _mm256_set1_epi32(cellX);
+    __m256i mapY = _mm256_set1_epi32(cellY);
+    __m256i side = _mm256_setzero_si256();
+    __m256i active = _mm256_set1_epi32(-1);
+    __m256i tiles_y = _mm256_set1_epi32(map->grid.tiles_y);
+    __m256i cell_mask = _mm256_set1_epi32(MAP_TILE_SIZE - 1);
+    int skipping = skip_enabled && map->grid.distance_valid;
+
+    int lanesX[8], lanesY[8];
+    while(_mm256_movemask_ps(_mm256_castsi256_ps(active))) {
+        __m256i far = _mm256_and_si256(active, _mm256_castps_si256(
+            _mm256_cmp_ps(_mm256_min_ps(sideDistX, sideDistY), _mm256_set1_ps(limit), _CMP_GT_OQ)));
+        side = _mm256_blendv_epi8(side, _mm256_set1_epi32(RAY_MISS), far);
+        active = _mm256_andnot_si256(far, active);
+        if(!_mm256_movemask_ps(_mm256_castsi256_ps(active))) break;
+        PROFILE_COUNT(COUNTER_DDA_STEPS, __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(active))));
+
+        __m256i stepping = active;
+        if(skipping) {
+            // Gather each lane's tile distance byte; non-zero means empty
+            __m256i tile = _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_srli_epi32(mapX, MAP_TILE_SHIFT), tiles_y),
+                _mm256_srli_epi32(mapY, MAP_TILE_SHIFT));
+            __m256i distance = _mm256_and_si256(_mm256_set1_epi32(0xFF),
+                _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                    (const int*)map->grid.tile_distance, tile, active, 1));
+            __m256i empty = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(distance, _mm256_setzero_si256()), active);
+            int jump = _mm256_movemask_ps(_mm256_castsi256_ps(empty));
+            if(jump) {
+                skip_empty_avx2(empty, distance, &mapX, &mapY, &sideDistX, &sideDistY,
+                                deltaDistX, deltaDistY, stepX, stepY, &side);
+                stepping = _mm256_andnot_si256(empty, active);
+            }
+        }
+
+        __m256i takeX = _mm256_and_si256(stepping,
+            _mm256_castps_si256(_mm256_cmp_ps(sideDistX, sideDistY, _CMP_LT_OQ)));
+        __m256i takeY = _mm256_andnot_si256(takeX, stepping);
+
+        sideDistX = _mm256_add_ps(sideDistX, _mm256_and_ps(_mm256_castsi256_ps(takeX), deltaDistX));
+        sideDistY = _mm256_add_ps(sideDistY, _mm256_and_ps(_mm256_castsi256_ps(takeY), deltaDistY));
+        mapX = _mm256_add_epi32(mapX, _mm256_and_si256(takeX, stepX));
+        mapY = _mm256_add_epi32(mapY, _mm256_and_si256(takeY, stepY));
+        side = _mm256_blendv_epi8(side, _mm256_srli_epi32(takeY, 31), stepping);
+
+        // Gather each lane's solidity word straight from the tile bitmap,
+        // read as 32 bit halves so one gather covers all eight lanes
+        __m256i tile = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srli_epi32(mapX, MAP_TILE_SHIFT), tiles_y),
+            _mm256_srli_epi32(mapY, MAP_TILE_SHIFT));
+        __m256i bit = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(mapX, cell_mask), MAP_TILE_SHIFT),
+            _mm256_and_si256(mapY, cell_mask));
+        __m256i word = _mm256_add_epi32(_mm256_slli_epi32(tile, 1), _mm256_srli_epi32(bit, 5));
+        __m256i bits = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+            (const int*)map->grid.solid, word, active, 4);
+        __m256i solid = _mm256_and_si256(
+            _mm256_srlv_epi32(bits, _mm256_and_si256(bit, _mm256_set1_epi32(31))),
+            _mm256_set1_epi32(1));
+        active = _mm256_andnot_si256(_mm256_cmpeq_epi32(solid, _mm256_set1_epi32(1)), active);
+    }
+
+    float dirsX[8], dirsY[8];
+    int steps_x[8], steps_y[8], sides[8];
+    _mm256_storeu_ps(dirsX, rayDirX);
+    _mm256_storeu_ps(dirsY, rayDirY);
+    _mm256_storeu_si256((__m256i*)lanesX, mapX);
+    _mm256_storeu_si256((__m256i*)lanesY, mapY);
+    _mm256_storeu_si256((__m256i*)steps_x, stepX);
+    _mm256_storeu_si256((__m256i*)steps_y, stepY);
+    _mm256_storeu_si256((__m256i*)sides, side);
+    for(int i = 0; i < 8; i++) {
+        hits[i] = (RayHit){dirsX[i], dirsY[i], lanesX[i], lanesY[i],
+                           steps_x[i], steps_y[i], sides[i]};
+    }
+}
+#endif
+
+int raycast_detect_isa() {
+#ifdef RAYCAST_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return RAY_ISA_AVX2;
+    if(__builtin_cpu_supports("sse2")) return RAY_ISA_SSE;
+#endif
+    return RAY_ISA_SCALAR;
+}
+
+int raycast_set_isa(int isa) {
+    int best = raycast_detect_isa();
+    if(isa < RAY_ISA_SCALAR || isa > best) isa = best;
+    __atomic_store_n(&selected_isa, isa, __ATOMIC_RELAXED);
+    return isa;
+}
+
+void raycast_set_skip(int enabled) {
+    skip_enabled = enabled;
+}
+
+int raycast_isa() {
+    int isa = __atomic_load_n(&selected_isa, __ATOMIC_RELAXED);
+    if(isa < 0) {
+        isa = raycast_detect_isa();
+        __atomic_store_n(&selected_isa, isa, __ATOMIC_RELAXED);
+    }
+    return isa;
+}
+
+const char* raycast_isa_name(int isa) {
+    switch(isa) {
+        case RAY_ISA_SSE: return "sse";
+        case RAY_ISA_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+void cast_rays(const Map* map, const Camera* camera, float max_distance,
+               int x_begin, int x_end, int columns, RayHit* hits) {
+    int x = x_begin;
+
+    // Rays are compared by distance along their normalised direction, which
+    // for the outermost columns is longest for a given perpendicular
+    // distance; scaling by that keeps every hit nearer than max_distance
+    float limit = INFINITY;
+    if(max_distance > 0.0f) {
+        float dirX = camera->dirX, dirY = camera->dirY;
+        float planeX = camera->planeX, planeY = camera->planeY;
+        float dirLength = sqrtf(dirX * dirX + dirY * dirY);
+        float edge = fmaxf(hypotf(dirX + planeX, dirY + planeY), hypotf(dirX - planeX, dirY - planeY));
+        limit = max_distance * edge / dirLength;
+    }
+
+#ifdef RAYCAST_X86
+    switch(raycast_isa()) {
+        case RAY_ISA_AVX2:
+            for(; x + 8 <= x_end; x += 8) cast_packet_avx2(map, camera, x, columns, limit, hits + (x - x_begin));
+            break;
+        case RAY_ISA_SSE:
+            for(; x + 4 <= x_end; x += 4) cast_packet_sse(map, camera, x, columns, limit, hits + (x - x_begin));
+            break;
+    }
+#endif
+
+    // Whatever doesn't fill a packet
+    for(; x < x_end; x++) cast_ray_scalar(map, camera, x, columns, limit, hits + (x - x_begin));
+}
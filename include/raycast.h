@@ -0,0 +1,40 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include "map.h"
+
+// Result of one screen column's DDA walk, enough for render_walls() to
+// work out the wall distance and texture column
+typedef struct {
+    float rayDirX, rayDirY;   // normalised ray direction
+    int mapX, mapY;           // cell that was hit
+    int stepX, stepY;
+    int side;                 // 0 when an x-side was hit, 1 for a y-side,
+                              // RAY_MISS past the distance limit
+} RayHit;
+
+#define RAY_MISS -1
+
+enum RAY_ISA { RAY_ISA_SCALAR, RAY_ISA_SSE, RAY_ISA_AVX2 };
+
+// Best packet width the CPU supports
+int raycast_detect_isa();
+// Forces a traversal path; anything the CPU lacks falls back to the best
+// supported one. Returns the path actually selected.
+int raycast_set_isa(int isa);
+int raycast_isa();
+const char* raycast_isa_name(int isa);
+
+// Jumping across empty regions of the map's tile distance field instead of
+// stepping through them cell by cell; on by default
+void raycast_set_skip(int enabled);
+
+// Casts the rays for columns [x_begin, x_end) of a view `columns` rays
+// wide from `camera` into `map`. Rays stop, with side RAY_MISS, once every
+// wall they could still hit is at least `max_distance` away perpendicular
+// to the camera; 0 casts until a wall is hit. Every path produces
+// bit-identical hits.
+void cast_rays(const Map* map, const Camera* camera, float max_distance,
+               int x_begin, int x_end, int columns, RayHit* hits);
+
+#endif
@@ -1,352 +1,1313 @@
-#include "render.h"
-#include <SDL2/SDL.h>
-#include <math.h>
-#include <string.h>
-#include <stdlib.h>
-
-enum TEXTURE_IDS { TEX_WALL, TEX_ENTITY, TEX_WEAPON };
-
-Texture textures[MAX_TEXTURES];
-Entity entities[MAX_ENTITIES];
-int entity_count = 0;
-
-WeaponState weapon_state = WEAPON_IDLE;
-int weapon_frame = 0;
-
-float fast_inv_sqrt(float x) {
-    union { float f; uint32_t i; } conv = {x};
-    conv.i = 0x5f3759df - (conv.i >> 1);
-    conv.f *= 1.5f - (x * 0.5f * conv.f * conv.f);
-    return conv.f;
-}
-
-void init_renderer(SDL_Window* window, SDL_Renderer** renderer, SDL_Texture** texture) {
-    *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    *texture = SDL_CreateTexture(*renderer, 
-        SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 
-        SCREEN_WIDTH, SCREEN_HEIGHT);
-}
-
-void render_walls() {
-    for(int x = 0; x < SCREEN_WIDTH; x++) {
-        // Raycasting calculations
-        float cameraX = 2 * x / (float)SCREEN_WIDTH - 1;
-        float rayDirX = dirX + planeX * cameraX;
-        float rayDirY = dirY + planeY * cameraX;
-
-        // Normalize ray direction
-        float len_sq = rayDirX*rayDirX + rayDirY*rayDirY;
-        float inv_len = fast_inv_sqrt(len_sq);
-        rayDirX *= inv_len;
-        rayDirY *= inv_len;
-
-        // DDA algorithm
-        int mapX = (int)posX;
-        int mapY = (int)posY;
-        float deltaDistX = fabsf(1 / rayDirX);
-        float deltaDistY = fabsf(1 / rayDirY);
-        
-        float sideDistX, sideDistY;
-        int stepX, stepY;
-        int hit = 0, side;
-
-        if(rayDirX < 0) {
-            stepX = -1;
-            sideDistX = (posX - mapX) * deltaDistX;
-        } else {
-            stepX = 1;
-            sideDistX = (mapX + 1.0f - posX) * deltaDistX;
-        }
-        if(rayDirY < 0) {
-            stepY = -1;
-            sideDistY = (posY - mapY) * deltaDistY;
-        } else {
-            stepY = 1;
-            sideDistY = (mapY + 1.0f - posY) * deltaDistY;
-        }
-
-        while(!hit) {
-            if(sideDistX < sideDistY) {
-                sideDistX += deltaDistX;
-                mapX += stepX;
-                side = 0;
-            } else {
-                sideDistY += deltaDistY;
-                mapY += stepY;
-                side = 1;
-            }
-            if(world_map[mapX][mapY] > 0) hit = 1;
-        }
-        
-        // Wall rendering code
-        // Calculate distance and wall position
-        float perpWallDist = side ? 
-        (mapY - posY + (1 - stepY)/2.0f) / rayDirY :
-        (mapX - posX + (1 - stepX)/2.0f) / rayDirX;
-    
-        int lineHeight = (int)(SCREEN_HEIGHT / perpWallDist);
-        int drawStart = -lineHeight / 2 + SCREEN_HEIGHT / 2;
-        int drawEnd = lineHeight / 2 + SCREEN_HEIGHT / 2;
-
-        // Texture calculations
-        float wallX;
-        if(side == 0) wallX = posY + perpWallDist * rayDirY;
-        else wallX = posX + perpWallDist * rayDirX;
-        wallX -= floor(wallX);
-
-        int texX = (int)(wallX * TEX_SIZE);
-        if((side == 0 && rayDirX > 0) || (side == 1 && rayDirY < 0))
-            texX = TEX_SIZE - texX - 1;
-
-        float step = 1.0f * TEX_SIZE / lineHeight;
-        float texPos = (drawStart - SCREEN_HEIGHT/2 + lineHeight/2) * step;
-        
-        // Texture mapping
-        for(int y = drawStart; y < drawEnd; y++) {
-            int texY = (int)texPos & (TEX_SIZE - 1);
-            texPos += step;
-            Uint32 color = textures[TEX_WALL].pixels[TEX_SIZE * texY + texX];
-            plot(x, y, color);
-        }
-    }
-}
-
-void render_entities() {
-    for(int i = 0; i < entity_count; i++) {
-        float dx = entities[i].x - posX;
-        float dy = entities[i].y - posY;
-        entities[i].distance = dx*dx + dy*dy;
-    }
-
-    // Bubble sort by distance
-    for(int i = 0; i < entity_count-1; i++) {
-        for(int j = 0; j < entity_count-i-1; j++) {
-            if(entities[j].distance < entities[j+1].distance) {
-                Entity temp = entities[j];
-                entities[j] = entities[j+1];
-                entities[j+1] = temp;
-            }
-        }
-    }
-
-    for(int i = 0; i < entity_count; i++) {
-        if(!entities[i].visible) continue;
-        
-        Texture* tex = &textures[entities[i].texture_id];
-        float spriteX = entities[i].x - posX;
-        float spriteY = entities[i].y - posY;
-        
-        float invDet = 1.0f / (planeX * dirY - dirX * planeY);
-        float transformX = invDet * (dirY * spriteX - dirX * spriteY);
-        float transformY = invDet * (-planeY * spriteX + planeX * spriteY);
-
-        int spriteScreenX = (int)((SCREEN_WIDTH / 2) * (1 + transformX / transformY));
-        int spriteHeight = abs((int)(SCREEN_HEIGHT / transformY));
-        int drawStartY = -spriteHeight / 2 + SCREEN_HEIGHT / 2;
-        int drawEndY = spriteHeight / 2 + SCREEN_HEIGHT / 2;
-        int drawStartX = -spriteHeight / 2 + spriteScreenX;
-        int drawEndX = spriteHeight / 2 + spriteScreenX;
-
-        for(int stripe = drawStartX; stripe < drawEndX; stripe++) {
-            if(stripe >= 0 && stripe < SCREEN_WIDTH && transformY > 0) {
-                int texX = (int)((stripe - drawStartX) * TEX_SIZE / (float)spriteHeight);
-                for(int y = drawStartY; y < drawEndY; y++) {
-                    if(y >= 0 && y < SCREEN_HEIGHT) {
-                        int texY = (int)((y - drawStartY) * TEX_SIZE / (float)spriteHeight);
-                        Uint32 color = tex->pixels[TEX_SIZE * texY + texX];
-                        // Skip magenta (0xFF00FF) transparent pixels
-                        if((color & 0xFFFFFF) != 0xFF00FF) {
-                            plot(stripe, y, color);
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-
-void handle_window_resize(SDL_Renderer* renderer, SDL_Texture** texture) {
-    SDL_DestroyTexture(*texture);
-    *texture = SDL_CreateTexture(renderer,
-        SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
-        SCREEN_WIDTH, SCREEN_HEIGHT);
-}
-
-void render_ui() {
-    char buffer[32];
-    uint32_t text_color = 0xFFFFFF; // White
-    int y_pos = SCREEN_HEIGHT - 30; // 10 pixels from bottom
-
-    // Calculate column width (1/4 of screen)
-    int col_width = SCREEN_WIDTH / 4;
-    int padding = 15;  // Minimum space from screen edges
-
-    // Draw what ever this is called
-    for(int y = y_pos - 10; y < SCREEN_HEIGHT; y++) {
-        for(int x = 0; x < SCREEN_WIDTH; x++) {
-            plot(x, y, 0x000000);
-        }
-    }
-
-    // Health percentage (left)
-    snprintf(buffer, sizeof(buffer), "HP");
-    draw_string(padding, y_pos, buffer, text_color);
-    snprintf(buffer, sizeof(buffer), "%3d%%", ui.health);
-    draw_string(padding, y_pos + 10, buffer, text_color);
-
-    // Score (center)
-    snprintf(buffer, sizeof(buffer), "SCORE");
-    draw_string(col_width + padding, y_pos, buffer, text_color);
-    snprintf(buffer, sizeof(buffer), "%06d", ui.score);
-    draw_string(col_width + padding, y_pos + 10, buffer, text_color);
-
-    // Ammo & Lives (right)
-    snprintf(buffer, sizeof(buffer), "AMMO");
-    draw_string(col_width * 2 + padding, y_pos, buffer, text_color);
-    snprintf(buffer, sizeof(buffer), "%03d", ui.ammo);
-    draw_string(col_width * 2 + padding, y_pos + 10, buffer, text_color);
-    
-    snprintf(buffer, sizeof(buffer), "LIVES");
-    draw_string(col_width * 3 + padding, y_pos, buffer, text_color);
-     snprintf(buffer, sizeof(buffer), "%02d", ui.lives);
-    draw_string(col_width * 3 + padding, y_pos + 10, buffer, text_color);
-}
-
-void update_weapon_animation() {
-    switch(weapon_state) {
-        case WEAPON_IDLE:
-            // Gentle sway
-            break;
-        case WEAPON_FIRING:
-            // Recoil animation
-            weapon_frame++;
-            if(weapon_frame > 10) {
-                weapon_state = WEAPON_IDLE;
-                weapon_frame = 0;
-            }
-            break;
-    }
-}
-
-
-void render_weapon() {
-    Texture* tex = &textures[TEX_WEAPON];
-    int screen_bottom = SCREEN_HEIGHT - 10;
-    
-    // Weapon dimensions
-    int frame_width = 64; // Each frame is 64x64
-    int frame_height = 64;
-    int weapon_height = SCREEN_HEIGHT / 2;
-    int weapon_width = (weapon_height * frame_width) / frame_height * 1.2;
-    int x_pos = (SCREEN_WIDTH - weapon_width) / 2;
-    int y_pos = screen_bottom - weapon_height - 30;
-
-    // Animation state
-    static int current_frame = 0;
-    static int animation_timer = 0;
-    const int frames_per_row = 5; // 320px / 64px = 5 frames
-    const int animation_speed = 5; // Frames per animation step
-
-    // Update animation
-    if(weapon_state == WEAPON_FIRING) {
-        animation_timer++;
-        if(animation_timer >= animation_speed) {
-            current_frame++;
-            animation_timer = 0;
-            
-            if(current_frame >= frames_per_row) {
-                current_frame = 0;
-                weapon_state = WEAPON_IDLE;
-            }
-        }
-    }
-
-    // Calculate frame position
-    int frame_x = current_frame * frame_width;
-
-    // Render current frame
-    float scale_x = (float)weapon_width / frame_width;
-    float scale_y = (float)weapon_height / frame_height;
-    
-    for(int y = 0; y < weapon_height; y++) {
-        for(int x = 0; x < weapon_width; x++) {
-            int tex_x = frame_x + (int)(x / scale_x);
-            int tex_y = (int)(y / scale_y);
-            uint32_t color = tex->pixels[tex_y * tex->width + tex_x];
-            
-            if((color & 0xFFFFFF) != 0xFF00FF) {
-                plot(x_pos + x, y_pos + y, color);
-            }
-        }
-    }
-}
-
-void render_frame(SDL_Renderer* renderer, SDL_Texture* screen_texture) {
-    static Uint32 last_frame_time = 0;
-    float delta_time = (SDL_GetTicks() - last_frame_time) / 1000.0f;
-    last_frame_time = SDL_GetTicks();
-
-    // Clear framebuffer
-    memset(framebuffer, 0, sizeof(framebuffer));
-    
-    static int last_w = 0, last_h = 0;
-    int w, h;
-    SDL_GetWindowSize(SDL_GetWindowFromID(SDL_GetWindowID(renderer)), &w, &h);
-    if(w != last_w || h != last_h) {
-        last_w = w;
-        last_h = h;
-        handle_window_resize(renderer, &screen_texture);
-    }
-
-    uint32_t dark_gray = 0x202020;  // Dark gray (RGB: 32,32,32)
-    uint32_t light_gray = 0x404040; // Light gray (RGB: 64,64,64)
-    int split_point = SCREEN_HEIGHT / 2; // Split screen in half
-
-    // Draw top half (dark gray)
-    for(int y = 0; y < split_point; y++) {
-        for(int x = 0; x < SCREEN_WIDTH; x++) {
-            plot(x, y, dark_gray);
-        }
-    }
-
-    // Draw bottom half (light gray)
-    for(int y = split_point; y < SCREEN_HEIGHT; y++) {
-        for(int x = 0; x < SCREEN_WIDTH; x++) {
-            plot(x, y, light_gray);
-        }
-    }
-
-    render_walls();
-    render_entities();
-    render_ui();
-    render_weapon();
-
-    if(ui.pickup_flash_timer > 0) {
-        uint32_t flash_color = 0xFFED29; // Green with 50% alpha
-        for(int y = 0; y < SCREEN_HEIGHT; y++) {
-            for(int x = 0; x < SCREEN_WIDTH; x++) {
-                // Blend with existing pixel
-                uint32_t bg = framebuffer[y * SCREEN_WIDTH + x];
-                framebuffer[y * SCREEN_WIDTH + x] = 
-                    ((bg & 0xFEFEFE) >> 1) + ((flash_color & 0xFEFEFE) >> 1);
-            }
-        }
-        ui.pickup_flash_timer -= delta_time;
-    }
-
-    if(ui.pickup_flash_timer > 0) ui.pickup_flash_timer -= delta_time;
-
-    // Update SDL texture
-    void* pixels;
-    int pitch;
-    SDL_LockTexture(screen_texture, NULL, &pixels, &pitch);
-    memcpy(pixels, framebuffer, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint32_t));
-    SDL_UnlockTexture(screen_texture);
-    SDL_RenderCopy(renderer, screen_texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
-}
-
-void cleanup_renderer(SDL_Renderer* renderer, SDL_Texture* texture) {
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-}
\ No newline at end of file
+#include "render.h"
+#include "thread_pool.h"
+#include "raycast.h"
+#include "postfx.h"
+#include "profile.h"
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Columns per work tile; 16 pixels keeps each tile's writes to a row on
+// its own cache line
+#define WALL_TILE_COLUMNS 16
+
+// Screen columns per wall ray; see render_set_column_step()
+#define MAX_COLUMN_STEP 4
+
+// Lighting. Fog and side shading scale each texel towards the fog colour
+// by a factor looked up from the distance, so applying them is a multiply
+// and an add on the red/blue and green lanes of a pixel. Levels run from
+// no fog at fog_start to solid fog colour at fog_end; y-sides are lit by
+// side_light. With both off nothing is shaded.
+#define SHADE_LEVELS 64
+
+typedef struct {
+    uint32_t mul;           // 0-256, what is kept of the texel
+    uint32_t add_rb, add_g; // fog colour share, pre-multiplied by 256
+} Shade;
+
+// Sprite pass: every visible sprite is projected and clipped to the screen
+// once, then binned into column tiles. Tiles are drawn in parallel, each
+// walking its bin far to near, so the result doesn't depend on threading.
+// Stripes behind the wall in their column are rejected using zbuffer.
+#define SPRITE_TILE_COLUMNS 16
+// Sprites nearer than this are drawn at this depth, so their size on
+// screen (at most view_height / SPRITE_MIN_DEPTH) always fits an int
+#define SPRITE_MIN_DEPTH (1.0f / 64.0f)
+
+typedef struct {
+    const uint32_t* texels; // mip level picked for the sprite's size
+    int height;             // of that level, the column stride
+    float depth;            // camera space distance, compared against zbuffer
+    int x0, x1, y0, y1;     // clipped screen rectangle, ends exclusive
+    int texX0, texY0;       // 16.16 texel position at (x0, y0)
+    int stepX, stepY;       // 16.16 texels per screen pixel
+    const Shade* shade;     // fog at the sprite's depth, NULL when unshaded
+} SpriteSpan;
+
+// The HUD is the bottom HUD_ROWS of the screen. It is drawn into its own
+// layer only when a value it shows changes (or the resolution does), and
+// copied over the frame otherwise.
+#define HUD_ROWS 40
+
+struct RenderView {
+    Surface frame;
+    Camera camera;
+    float interpolation_alpha;
+
+    // Perpendicular wall distance per column, written by render_walls()
+    float* zbuffer;
+    // Rows [wall_top[x], wall_bottom[x]) of each column hold wall, written
+    // by render_walls(); render_floor() fills exactly the rows around them
+    int32_t* wall_top;
+    int32_t* wall_bottom;
+    // Pixel height of a wall one cell away. Tied to the width, as for 4:3,
+    // so the fixed field of view isn't stretched on wide screens.
+    int view_height;
+    int column_step;
+
+    Shade shades[2][SHADE_LEVELS];  // by side, then distance level
+    int shading;
+    int fog_enabled;
+    int fog_culling;
+    uint32_t fog_color;
+    float fog_start, fog_end;
+    float fog_level_scale;
+    float side_light;
+
+    SpriteSpan* sprite_spans;
+    int sprite_span_count;
+    int sprite_span_capacity;
+    // Span indices per tile, far to near, laid out back to back
+    int* sprite_bins;
+    int sprite_bin_capacity;
+    int sprite_tiles;
+    int* sprite_bin_start;  // sprite_tiles + 1 entries
+    int* sprite_bin_fill;
+
+    // Draw order lives in its own index array so sorting never moves the
+    // entities gameplay code is iterating over. Keys are the squared
+    // distance's float bits, inverted so that ascending order is far to
+    // near; for non-negative floats the bit pattern sorts like the value.
+    uint32_t* sort_order;
+    uint32_t* sort_keys;
+    uint32_t* sort_scratch;
+    int sort_count;
+    int sort_capacity;
+    unsigned sorted_version;        // entity store version sort_order holds
+
+    Surface hud_layer;
+    int hud_valid;
+    UIState hud_shown;
+
+    int floor_texture;
+    int ceiling_texture;
+
+    PostFx postfx;
+    int flash_pass;
+    int damage_pass;
+    int gamma_pass;
+    float gamma_value;
+
+    // Dynamic resolution, see render_report_frame_time()
+    float target_frame_seconds;
+    float average_frame_seconds;
+    int frames_since_step_change;
+};
+
+static void build_shades(RenderView* view) {
+    for(int side = 0; side < 2; side++) {
+        float light = side ? view->side_light : 1.0f;
+        for(int level = 0; level < SHADE_LEVELS; level++) {
+            float fog = view->fog_enabled ? (float)level / (SHADE_LEVELS - 1) : 0.0f;
+            uint32_t keep = (uint32_t)((1.0f - fog) * light * 256.0f + 0.5f);
+            uint32_t share = (uint32_t)(fog * 256.0f + 0.5f);
+            if(keep + share > 256) share = 256 - keep;
+            view->shades[side][level] = (Shade){
+                keep,
+                ((view->fog_color & 0xFF00FF) * share) & 0xFF00FF00,
+                ((view->fog_color & 0x00FF00) * share) & 0x00FF0000
+            };
+        }
+    }
+    view->shading = view->fog_enabled || view->side_light != 1.0f;
+    view->fog_level_scale = view->fog_enabled ? (SHADE_LEVELS - 1) / (view->fog_end - view->fog_start) : 0.0f;
+}
+
+static const Shade* shade_at(const RenderView* view, float distance, int side) {
+    int level = 0;
+    if(distance > view->fog_start) {
+        float f = (distance - view->fog_start) * view->fog_level_scale + 0.5f;
+        level = f >= SHADE_LEVELS - 1 ? SHADE_LEVELS - 1 : (int)f;
+    }
+    return &view->shades[side][level];
+}
+
+static inline uint32_t shade_pixel(uint32_t color, const Shade* shade) {
+    uint32_t rb = ((color & 0xFF00FF) * shade->mul + shade->add_rb) >> 8;
+    uint32_t g = ((color & 0x00FF00) * shade->mul + shade->add_g) >> 8;
+    return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+void render_set_fog(RenderView* view, uint32_t color, float start, float end) {
+    view->fog_enabled = end > start;
+    view->fog_color = color & 0xFFFFFF;
+    view->fog_start = start;
+    view->fog_end = end;
+    build_shades(view);
+}
+
+void render_set_fog_culling(RenderView* view, int enabled) {
+    view->fog_culling = enabled;
+}
+
+void render_set_side_light(RenderView* view, float light) {
+    view->side_light = light < 0.0f ? 0.0f : (light > 1.0f ? 1.0f : light);
+    build_shades(view);
+}
+
+// Fills `count` pixels down a screen column from one contiguous texture
+// column, stepping a 16.16 texel position and wrapping every `height`
+// texels. Always inlined so the power-of-two samplers below get the wrap
+// as a constant mask, and the unshaded ones drop the shading.
+static inline __attribute__((always_inline))
+void wall_span_kernel(uint32_t* out, int stride, const uint32_t* column, int height, uint32_t texPos, uint32_t step,
+                      int count, const Shade* shade) {
+    int pow2 = (height & (height - 1)) == 0;
+    for(int i = 0; i < count; i++) {
+        int texY = pow2 ? (texPos >> 16) & (height - 1) : (texPos >> 16) % height;
+        texPos += step;
+        *out = shade ? shade_pixel(column[texY], shade) : column[texY];
+        out += stride;
+    }
+}
+
+// One sampler per power-of-two height, unshaded and shaded;
+// wall_span_generic() covers every other texture
+#define DEFINE_WALL_SPAN(SHIFT) \
+static void wall_span_##SHIFT(uint32_t* out, int stride, const uint32_t* column, int height, uint32_t texPos, uint32_t step, int count, const Shade* shade) { \
+    (void)height; \
+    (void)shade; \
+    wall_span_kernel(out, stride, column, 1 << SHIFT, texPos, step, count, NULL); \
+} \
+static void wall_span_shaded_##SHIFT(uint32_t* out, int stride, const uint32_t* column, int height, uint32_t texPos, uint32_t step, int count, const Shade* shade) { \
+    (void)height; \
+    wall_span_kernel(out, stride, column, 1 << SHIFT, texPos, step, count, shade); \
+}
+
+DEFINE_WALL_SPAN(0)
+DEFINE_WALL_SPAN(1)
+DEFINE_WALL_SPAN(2)
+DEFINE_WALL_SPAN(3)
+DEFINE_WALL_SPAN(4)
+DEFINE_WALL_SPAN(5)
+DEFINE_WALL_SPAN(6)
+DEFINE_WALL_SPAN(7)
+
+typedef void (*WallSpanFunc)(uint32_t* out, int stride, const uint32_t* column, int height, uint32_t texPos, uint32_t step,
+                             int count, const Shade* shade);
+
+static const WallSpanFunc wall_spans[2][8] = {
+    {wall_span_0, wall_span_1, wall_span_2, wall_span_3,
+     wall_span_4, wall_span_5, wall_span_6, wall_span_7},
+    {wall_span_shaded_0, wall_span_shaded_1, wall_span_shaded_2, wall_span_shaded_3,
+     wall_span_shaded_4, wall_span_shaded_5, wall_span_shaded_6, wall_span_shaded_7}
+};
+
+static void wall_span_generic(uint32_t* out, int stride, const uint32_t* column, int height, uint32_t texPos, uint32_t step,
+                              int count, const Shade* shade) {
+    wall_span_kernel(out, stride, column, height, texPos, step, count, shade);
+}
+
+static void draw_wall_column(RenderView* view, const Map* map, int x0, int width, const RayHit* ray) {
+    // Locals, as pixel stores may alias anything int sized in the view
+    int screen_width = view->frame.width, screen_height = view->frame.height;
+    float posX = view->camera.posX, posY = view->camera.posY;
+    float* zbuffer = view->zbuffer;
+    int32_t* wall_top = view->wall_top;
+    int32_t* wall_bottom = view->wall_bottom;
+    float rayDirX = ray->rayDirX, rayDirY = ray->rayDirY;
+    int mapX = ray->mapX, mapY = ray->mapY;
+    int stepX = ray->stepX, stepY = ray->stepY;
+    int side = ray->side;
+
+    // Stopped in the fog: no wall, the floor and ceiling fill the column
+    if(side == RAY_MISS) {
+        for(int x = x0; x < x0 + width; x++) {
+            zbuffer[x] = view->fog_end;
+            wall_top[x] = wall_bottom[x] = screen_height / 2;
+        }
+        return;
+    }
+
+    // Wall rendering code
+    // Calculate distance and wall position
+    float perpWallDist = side ? 
+    (mapY - posY + (1 - stepY)/2.0f) / rayDirY :
+    (mapX - posX + (1 - stepX)/2.0f) / rayDirX;
+    
+    int lineHeight = (int)(view->view_height / perpWallDist);
+    int drawStart = -lineHeight / 2 + screen_height / 2;
+    int drawEnd = lineHeight / 2 + screen_height / 2;
+    if(drawStart < 0) drawStart = 0;
+    if(drawEnd > screen_height) drawEnd = screen_height;
+    for(int x = x0; x < x0 + width; x++) {
+        zbuffer[x] = perpWallDist;
+        wall_top[x] = drawStart;
+        wall_bottom[x] = drawEnd;
+    }
+    if(drawStart >= drawEnd) return;
+
+    // Each cell value picks its own wall texture; far walls read a smaller
+    // mip level so neighbouring columns stay in cache and don't shimmer
+    const Texture* tex = texture_for_material(map_get(map, mapX, mapY));
+    int level = texture_mip_level(tex, lineHeight);
+    int texWidth = tex->width >> level;
+    int texHeight = tex->height >> level;
+
+    // Texture calculations
+    float wallX;
+    if(side == 0) wallX = posY + perpWallDist * rayDirY;
+    else wallX = posX + perpWallDist * rayDirX;
+    wallX -= floor(wallX);
+
+    int texX = (int)(wallX * texWidth);
+    if((side == 0 && rayDirX > 0) || (side == 1 && rayDirY < 0))
+        texX = texWidth - texX - 1;
+
+    // 16.16 texels per screen pixel
+    uint32_t step = ((uint64_t)texHeight << 16) / lineHeight;
+    uint32_t texPos = (uint32_t)((int64_t)(drawStart - screen_height/2 + lineHeight/2) * step);
+    
+    // Texture mapping
+    uint32_t* out = view->frame.pixels + drawStart * screen_width + x0;
+    const uint32_t* column = tex->mips[level] + texX * texHeight;
+    int shading = view->shading;
+    const Shade* shade = shading ? shade_at(view, perpWallDist, side) : NULL;
+    WallSpanFunc span = wall_span_generic;
+    if(tex->shift >= 0 && tex->shift - level < (int)(sizeof(wall_spans[0]) / sizeof(wall_spans[0][0]))) {
+        span = wall_spans[shading][tex->shift - level];
+    }
+    span(out, screen_width, column, texHeight, texPos, step, drawEnd - drawStart, shade);
+    PROFILE_COUNT(COUNTER_PIXELS, (drawEnd - drawStart) * width);
+
+    if(width > 1) {
+        int stride = screen_width;
+        for(int y = drawStart; y < drawEnd; y++, out += stride) {
+            for(int i = 1; i < width; i++) out[i] = out[0];
+        }
+    }
+}
+
+static int wall_ray_count(const RenderView* view) {
+    return (view->frame.width + view->column_step - 1) / view->column_step;
+}
+
+// What a pass hands each of its thread pool tiles
+typedef struct {
+    RenderView* view;
+    const World* world;
+} PassJob;
+
+static void render_wall_columns(void* data, int x_begin, int x_end) {
+    const PassJob* job = data;
+    RenderView* view = job->view;
+    const Map* map = job->world->map;
+    RayHit hits[WALL_TILE_COLUMNS];
+    int rays = wall_ray_count(view);
+    int screen_width = view->frame.width, column_step = view->column_step;
+    float max_distance = view->fog_enabled && view->fog_culling ? view->fog_end : 0.0f;
+
+    // Trace a tile's worth of rays as packets, then texture each column
+    for(int x0 = x_begin; x0 < x_end; x0 += WALL_TILE_COLUMNS) {
+        int x1 = x0 + WALL_TILE_COLUMNS < x_end ? x0 + WALL_TILE_COLUMNS : x_end;
+        cast_rays(map, &view->camera, max_distance, x0, x1, rays, hits);
+        for(int x = x0; x < x1; x++) {
+            int screen_x = x * column_step;
+            int width = screen_width - screen_x < column_step ? screen_width - screen_x : column_step;
+            draw_wall_column(view, map, screen_x, width, &hits[x - x0]);
+        }
+    }
+}
+
+// Every ray is independent, so the pass is split into tiles of rays across
+// the thread pool. Output matches the serial loop exactly.
+void render_walls(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_WALLS);
+    PassJob job = {view, world};
+    parallel_for(wall_ray_count(view), WALL_TILE_COLUMNS, render_wall_columns, &job);
+    PROFILE_END(ZONE_WALLS);
+}
+
+// Below this many entities a plain insertion sort beats the radix passes
+#define SPRITE_RADIX_MIN 64
+
+void render_set_interpolation(RenderView* view, float alpha) {
+    view->interpolation_alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
+
+// Entity position at the interpolated time; exactly entities.x/y at alpha 1
+static float sprite_pos_x(const RenderView* view, const EntityStore* entities, int i) {
+    float alpha = view->interpolation_alpha;
+    if(alpha >= 1.0f) return entities->x[i];
+    return entities->prev_x[i] + (entities->x[i] - entities->prev_x[i]) * alpha;
+}
+
+static float sprite_pos_y(const RenderView* view, const EntityStore* entities, int i) {
+    float alpha = view->interpolation_alpha;
+    if(alpha >= 1.0f) return entities->y[i];
+    return entities->prev_y[i] + (entities->y[i] - entities->prev_y[i]) * alpha;
+}
+
+static uint32_t sprite_sort_key(const RenderView* view, const EntityStore* entities, int index) {
+    float dx = sprite_pos_x(view, entities, index) - view->camera.posX;
+    float dy = sprite_pos_y(view, entities, index) - view->camera.posY;
+    union { float f; uint32_t u; } distance = {dx*dx + dy*dy};
+    return ~distance.u;
+}
+
+// 0 when out of memory. Buffers that did grow are kept, but the capacity
+// only moves once all three have.
+static int reserve_sort_buffers(RenderView* view, int count) {
+    if(view->sort_capacity >= count) return 1;
+    int capacity = count * 2;
+    uint32_t* order = realloc(view->sort_order, capacity * sizeof(uint32_t));
+    if(order) view->sort_order = order;
+    uint32_t* keys = realloc(view->sort_keys, capacity * sizeof(uint32_t));
+    if(keys) view->sort_keys = keys;
+    uint32_t* scratch = realloc(view->sort_scratch, 2 * capacity * sizeof(uint32_t));
+    if(scratch) view->sort_scratch = scratch;
+    if(!order || !keys || !scratch) return 0;
+    view->sort_capacity = capacity;
+    return 1;
+}
+
+// Stable insertion sort of (key, index) pairs. Gives up and returns 0 once
+// it has shifted more than `budget` elements, leaving a valid permutation.
+static int insertion_sort_sprites(RenderView* view, int budget) {
+    uint32_t* sort_keys = view->sort_keys;
+    uint32_t* sort_order = view->sort_order;
+    int sort_count = view->sort_count;
+    for(int i = 1; i < sort_count; i++) {
+        uint32_t key = sort_keys[i], index = sort_order[i];
+        int j = i - 1;
+        while(j >= 0 && sort_keys[j] > key) {
+            sort_keys[j + 1] = sort_keys[j];
+            sort_order[j + 1] = sort_order[j];
+            j--;
+            if(--budget < 0) {
+                sort_keys[j + 1] = key;
+                sort_order[j + 1] = index;
+                return 0;
+            }
+        }
+        sort_keys[j + 1] = key;
+        sort_order[j + 1] = index;
+    }
+    return 1;
+}
+
+// LSD radix sort, 8 bits per pass; passes where every key shares the same
+// byte are skipped
+static void radix_sort_sprites(RenderView* view) {
+    uint32_t* sort_keys = view->sort_keys;
+    uint32_t* sort_order = view->sort_order;
+    int sort_count = view->sort_count;
+    uint32_t* keys_out = view->sort_scratch;
+    uint32_t* order_out = view->sort_scratch + view->sort_capacity;
+
+    for(int shift = 0; shift < 32; shift += 8) {
+        int counts[256] = {0};
+        for(int i = 0; i < sort_count; i++) counts[(sort_keys[i] >> shift) & 0xFF]++;
+        if(counts[(sort_keys[0] >> shift) & 0xFF] == sort_count) continue;
+
+        int offset = 0;
+        for(int b = 0; b < 256; b++) {
+            int c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for(int i = 0; i < sort_count; i++) {
+            int dst = counts[(sort_keys[i] >> shift) & 0xFF]++;
+            keys_out[dst] = sort_keys[i];
+            order_out[dst] = sort_order[i];
+        }
+
+        uint32_t* tmp = sort_keys;
+        sort_keys = keys_out;
+        keys_out = tmp;
+        tmp = sort_order;
+        sort_order = order_out;
+        order_out = tmp;
+    }
+
+    // Keep the scratch area as one contiguous block for the next frame
+    if(keys_out != view->sort_scratch) {
+        memcpy(keys_out, sort_keys, sort_count * sizeof(uint32_t));
+        memcpy(order_out, sort_order, sort_count * sizeof(uint32_t));
+        uint32_t* tmp = sort_keys;
+        sort_keys = keys_out;
+        keys_out = tmp;
+        tmp = sort_order;
+        sort_order = order_out;
+        order_out = tmp;
+    }
+    view->sort_keys = sort_keys;
+    view->sort_order = sort_order;
+}
+
+// Sorts every live entity far to near. While the set of entities is
+// unchanged the previous frame's order is nearly right, so it is re-keyed
+// and fixed up with an insertion sort, falling back to radix sort when
+// things moved too much.
+// 0 when out of memory
+static int sort_sprites(RenderView* view, const EntityStore* entities) {
+    int reuse = view->sorted_version == entities->version && view->sort_count > 0;
+
+    if(!reuse) {
+        if(!reserve_sort_buffers(view, entities->count)) return 0;
+        int count = 0;
+        for(int i = 0; i < entities->count; i++) {
+            if(entity_alive(entities, i)) view->sort_order[count++] = i;
+        }
+        view->sort_count = count;
+        view->sorted_version = entities->version;
+    }
+
+    int sort_count = view->sort_count;
+    PROFILE_COUNT(COUNTER_SORTED, sort_count);
+    for(int i = 0; i < sort_count; i++) view->sort_keys[i] = sprite_sort_key(view, entities, view->sort_order[i]);
+
+    if(sort_count < SPRITE_RADIX_MIN) {
+        insertion_sort_sprites(view, sort_count * sort_count);
+    } else if(!reuse || !insertion_sort_sprites(view, 2 * sort_count)) {
+        radix_sort_sprites(view);
+    }
+    return 1;
+}
+
+// 0 when out of memory, leaving the spans as they were
+static int project_sprites(RenderView* view, const EntityStore* entities) {
+    int sort_count = view->sort_count;
+    if(view->sprite_span_capacity < sort_count) {
+        SpriteSpan* spans = realloc(view->sprite_spans, sort_count * sizeof(SpriteSpan));
+        if(!spans) return 0;
+        view->sprite_spans = spans;
+        view->sprite_span_capacity = sort_count;
+    }
+
+    int screen_width = view->frame.width, screen_height = view->frame.height;
+    int view_height = view->view_height;
+    float posX = view->camera.posX, posY = view->camera.posY;
+    float dirX = view->camera.dirX, dirY = view->camera.dirY;
+    float planeX = view->camera.planeX, planeY = view->camera.planeY;
+    float invDet = 1.0f / (planeX * dirY - dirX * planeY);
+    int count = 0;
+
+    for(int n = 0; n < sort_count; n++) {
+        int i = view->sort_order[n];
+        if(!entity_visible(entities, i)) continue;
+
+        float spriteX = sprite_pos_x(view, entities, i) - posX;
+        float spriteY = sprite_pos_y(view, entities, i) - posY;
+        float transformX = invDet * (dirY * spriteX - dirX * spriteY);
+        float transformY = invDet * (-planeY * spriteX + planeX * spriteY);
+        if(transformY <= 0) continue;
+        if(transformY < SPRITE_MIN_DEPTH) transformY = SPRITE_MIN_DEPTH;
+
+        int spriteHeight = (int)(view_height / transformY);
+        if(spriteHeight <= 0) continue;
+        // Off to the side entirely; also keeps the centre in int range
+        float screenX = (screen_width / 2) * (1 + transformX / transformY);
+        if(screenX + spriteHeight / 2 < 0 || screenX - spriteHeight / 2 > screen_width) continue;
+        int spriteScreenX = (int)screenX;
+
+        int drawStartY = -spriteHeight / 2 + screen_height / 2;
+        int drawEndY = spriteHeight / 2 + screen_height / 2;
+        int drawStartX = -spriteHeight / 2 + spriteScreenX;
+        int drawEndX = spriteHeight / 2 + spriteScreenX;
+
+        SpriteSpan* span = &view->sprite_spans[count];
+        span->x0 = drawStartX < 0 ? 0 : drawStartX;
+        span->x1 = drawEndX > screen_width ? screen_width : drawEndX;
+        span->y0 = drawStartY < 0 ? 0 : drawStartY;
+        span->y1 = drawEndY > screen_height ? screen_height : drawEndY;
+        if(span->x0 >= span->x1 || span->y0 >= span->y1) continue;
+
+        const Texture* tex = &textures[entities->texture_id[i]];
+        int level = texture_mip_level(tex, spriteHeight);
+        span->texels = tex->mips[level];
+        span->height = tex->height >> level;
+        span->depth = transformY;
+        span->stepX = ((tex->width >> level) << 16) / spriteHeight;
+        span->stepY = (span->height << 16) / spriteHeight;
+        span->texX0 = (span->x0 - drawStartX) * span->stepX;
+        span->texY0 = (span->y0 - drawStartY) * span->stepY;
+        span->shade = view->shading ? shade_at(view, transformY, 0) : NULL;
+        count++;
+    }
+    view->sprite_span_count = count;
+    return 1;
+}
+
+static int sprite_first_tile(const SpriteSpan* span) {
+    return span->x0 / SPRITE_TILE_COLUMNS;
+}
+
+static int sprite_last_tile(const SpriteSpan* span) {
+    return (span->x1 - 1) / SPRITE_TILE_COLUMNS;
+}
+
+// Counting sort of the spans into their column tiles, keeping draw order;
+// 0 when out of memory
+static int bin_sprites(RenderView* view) {
+    const SpriteSpan* spans = view->sprite_spans;
+    int span_count = view->sprite_span_count;
+    int tiles = view->sprite_tiles;
+    int* counts = view->sprite_bin_fill;
+    int* bin_start = view->sprite_bin_start;
+    int total = 0;
+
+    memset(counts, 0, tiles * sizeof(int));
+    for(int i = 0; i < span_count; i++) {
+        for(int t = sprite_first_tile(&spans[i]); t <= sprite_last_tile(&spans[i]); t++) {
+            counts[t]++;
+            total++;
+        }
+    }
+
+    if(view->sprite_bin_capacity < total) {
+        int* grown = realloc(view->sprite_bins, total * sizeof(int));
+        if(!grown) return 0;
+        view->sprite_bins = grown;
+        view->sprite_bin_capacity = total;
+    }
+    int* bins = view->sprite_bins;
+
+    // counts becomes each tile's fill position
+    int* fill = counts;
+    bin_start[0] = 0;
+    for(int t = 0; t < tiles; t++) {
+        bin_start[t + 1] = bin_start[t] + counts[t];
+        fill[t] = bin_start[t];
+    }
+
+    for(int i = 0; i < span_count; i++) {
+        for(int t = sprite_first_tile(&spans[i]); t <= sprite_last_tile(&spans[i]); t++) {
+            bins[fill[t]++] = i;
+        }
+    }
+    return 1;
+}
+
+static void draw_sprite_stripes(const RenderView* view, const SpriteSpan* span, int x_begin, int x_end) {
+    int stride = view->frame.width;
+    const float* zbuffer = view->zbuffer;
+    uint32_t* pixels = view->frame.pixels;
+    for(int stripe = x_begin; stripe < x_end; stripe++) {
+        // Hidden behind the wall in this column
+        if(span->depth >= zbuffer[stripe]) continue;
+        PROFILE_COUNT(COUNTER_SPRITE_PIXELS, span->y1 - span->y0);
+        PROFILE_COUNT(COUNTER_PIXELS, span->y1 - span->y0);
+
+        // Texture columns are contiguous, so the stripe streams through one
+        int texX = (span->texX0 + (stripe - span->x0) * span->stepX) >> 16;
+        const uint32_t* column = span->texels + texX * span->height;
+        uint32_t* out = pixels + span->y0 * stride + stripe;
+        int texPos = span->texY0;
+
+        for(int y = span->y0; y < span->y1; y++) {
+            uint32_t color = column[texPos >> 16];
+            // Skip magenta (0xFF00FF) transparent pixels
+            if((color & 0xFFFFFF) != 0xFF00FF) *out = span->shade ? shade_pixel(color, span->shade) : color;
+            out += stride;
+            texPos += span->stepY;
+        }
+    }
+}
+
+static void render_sprite_tiles(void* data, int tile_begin, int tile_end) {
+    const RenderView* view = data;
+    int screen_width = view->frame.width;
+    for(int t = tile_begin; t < tile_end; t++) {
+        int tile_x0 = t * SPRITE_TILE_COLUMNS;
+        int tile_x1 = tile_x0 + SPRITE_TILE_COLUMNS;
+        if(tile_x1 > screen_width) tile_x1 = screen_width;
+
+        for(int b = view->sprite_bin_start[t]; b < view->sprite_bin_start[t + 1]; b++) {
+            const SpriteSpan* span = &view->sprite_spans[view->sprite_bins[b]];
+            int x0 = span->x0 > tile_x0 ? span->x0 : tile_x0;
+            int x1 = span->x1 < tile_x1 ? span->x1 : tile_x1;
+            draw_sprite_stripes(view, span, x0, x1);
+        }
+    }
+}
+
+void render_entities(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_ENTITIES);
+    // Out of memory: no sprites this frame
+    if(sort_sprites(view, &world->entities) && project_sprites(view, &world->entities) && bin_sprites(view)) {
+        parallel_for(view->sprite_tiles, 1, render_sprite_tiles, view);
+    }
+    PROFILE_END(ZONE_ENTITIES);
+}
+
+static void rasterize_hud(RenderView* view, const UIState* ui) {
+    char buffer[32];
+    uint32_t text_color = 0xFFFFFF; // White
+    Surface* hud = &view->hud_layer;
+    int w = hud->width;
+    int y_pos = 10; // Label row, 30 pixels from the bottom
+
+    // Calculate column width (1/4 of screen)
+    int col_width = w / 4;
+    int padding = 15;  // Minimum space from screen edges
+
+    // Status bar background
+    memset(hud->pixels, 0, w * HUD_ROWS * sizeof(uint32_t));
+
+    // Health percentage (left)
+    draw_string(hud, padding, y_pos, "HP", text_color);
+    snprintf(buffer, sizeof(buffer), "%3d%%", ui->health);
+    draw_string(hud, padding, y_pos + 10, buffer, text_color);
+
+    // Score (center)
+    draw_string(hud, col_width + padding, y_pos, "SCORE", text_color);
+    snprintf(buffer, sizeof(buffer), "%06d", ui->score);
+    draw_string(hud, col_width + padding, y_pos + 10, buffer, text_color);
+
+    // Ammo & Lives (right)
+    draw_string(hud, col_width * 2 + padding, y_pos, "AMMO", text_color);
+    snprintf(buffer, sizeof(buffer), "%03d", ui->ammo);
+    draw_string(hud, col_width * 2 + padding, y_pos + 10, buffer, text_color);
+
+    draw_string(hud, col_width * 3 + padding, y_pos, "LIVES", text_color);
+    snprintf(buffer, sizeof(buffer), "%02d", ui->lives);
+    draw_string(hud, col_width * 3 + padding, y_pos + 10, buffer, text_color);
+
+    view->hud_shown = *ui;
+    view->hud_valid = 1;
+}
+
+void render_ui(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_UI);
+    const UIState* ui = &world->ui;
+    const UIState* shown = &view->hud_shown;
+    if(!view->hud_valid || ui->health != shown->health || ui->ammo != shown->ammo ||
+       ui->score != shown->score || ui->lives != shown->lives) {
+        rasterize_hud(view, ui);
+    }
+
+    // Rows above the top of a very short screen are left out
+    int screen_width = view->frame.width, screen_height = view->frame.height;
+    int skip = screen_height < HUD_ROWS ? HUD_ROWS - screen_height : 0;
+    memcpy(view->frame.pixels + (screen_height - HUD_ROWS + skip) * screen_width,
+           view->hud_layer.pixels + skip * screen_width,
+           (HUD_ROWS - skip) * screen_width * sizeof(uint32_t));
+    PROFILE_COUNT(COUNTER_PIXELS, (HUD_ROWS - skip) * screen_width);
+    PROFILE_END(ZONE_UI);
+}
+
+void render_weapon(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_WEAPON);
+    Texture* tex = &textures[TEX_WEAPON];
+    int screen_width = view->frame.width, screen_height = view->frame.height;
+    int screen_bottom = screen_height - 10;
+    
+    // Weapon dimensions
+    int frame_width = 64; // Each frame is 64x64
+    int frame_height = 64;
+    int weapon_height = screen_height / 2;
+    int weapon_width = (weapon_height * frame_width) / frame_height * 1.2;
+    int x_pos = (screen_width - weapon_width) / 2;
+    int y_pos = screen_bottom - weapon_height - 30;
+
+    // Current animation frame, advanced by world_tick()
+    int frame_x = world->weapon_frame * frame_width;
+
+    // Render current frame
+    blit_keyed(&view->frame, tex, frame_x, 0, frame_width, frame_height,
+               x_pos, y_pos, weapon_width, weapon_height, 0xFF00FF);
+    PROFILE_END(ZONE_WEAPON);
+}
+
+// Floor and ceiling casting. Each screen row looks at the floor (or the
+// ceiling) at one distance, so its world position moves by a constant step
+// per column; that walk is done in 16.16 fixed point. Rows are split across
+// the thread pool.
+#define FLOOR_TILE_ROWS 8
+
+void render_set_surfaces(RenderView* view, int floor_id, int ceiling_id) {
+    if(floor_id >= 0 && floor_id < texture_count) view->floor_texture = floor_id;
+    if(ceiling_id >= 0 && ceiling_id < texture_count) view->ceiling_texture = ceiling_id;
+}
+
+// One row's texture walk: texel (u, v) for column x is read at
+// u + x * du, v + x * dv, 16.16 in world cells
+typedef struct {
+    const uint32_t* texels;
+    int shift;          // log2 of the mip level's size
+    int32_t u, v;
+    int32_t du, dv;
+    const Shade* shade; // fog at the row's distance, NULL when unshaded
+} FloorSpan;
+
+// Columns whose wall doesn't cover row y: above it for the ceiling, below
+// it for the floor
+static inline int floor_visible(const RenderView* view, int x, int y, int ceiling) {
+    return ceiling ? y < view->wall_top[x] : y >= view->wall_bottom[x];
+}
+
+static void floor_row_scalar(const RenderView* view, uint32_t* out, int y, int ceiling, const FloorSpan* span,
+                             int x_begin) {
+    int fraction = 16 - span->shift;
+    int32_t mask = (1 << span->shift) - 1;
+    int32_t u = span->u + x_begin * span->du;
+    int32_t v = span->v + x_begin * span->dv;
+    int width = view->frame.width;
+
+    for(int x = x_begin; x < width; x++) {
+        if(floor_visible(view, x, y, ceiling)) {
+            int32_t tu = (u >> fraction) & mask;
+            int32_t tv = (v >> fraction) & mask;
+            uint32_t color = span->texels[(tu << span->shift) | tv];
+            out[x] = span->shade ? shade_pixel(color, span->shade) : color;
+        }
+        u += span->du;
+        v += span->dv;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// shade_pixel() on eight pixels
+__attribute__((target("avx2")))
+static inline __m256i shade_avx2(__m256i color, const Shade* shade) {
+    __m256i mul = _mm256_set1_epi32(shade->mul);
+    __m256i rb = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(color, _mm256_set1_epi32(0xFF00FF)), mul),
+                                  _mm256_set1_epi32(shade->add_rb));
+    __m256i g = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(color, _mm256_set1_epi32(0x00FF00)), mul),
+                                 _mm256_set1_epi32(shade->add_g));
+    return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(rb, 8), _mm256_set1_epi32(0xFF00FF)),
+                           _mm256_and_si256(_mm256_srli_epi32(g, 8), _mm256_set1_epi32(0x00FF00)));
+}
+
+// Eight columns at a time: gather the texels, then a masked store keeps
+// every pixel the wall already owns
+__attribute__((target("avx2")))
+static void floor_row_avx2(const RenderView* view, uint32_t* out, int y, int ceiling, const FloorSpan* span) {
+    __m128i fraction = _mm_cvtsi32_si128(16 - span->shift);
+    __m128i shift = _mm_cvtsi32_si128(span->shift);
+    __m256i mask = _mm256_set1_epi32((1 << span->shift) - 1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i u = _mm256_add_epi32(_mm256_set1_epi32(span->u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->du)));
+    __m256i v = _mm256_add_epi32(_mm256_set1_epi32(span->v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span->dv)));
+    __m256i du = _mm256_set1_epi32(span->du * 8);
+    __m256i dv = _mm256_set1_epi32(span->dv * 8);
+    __m256i row = _mm256_set1_epi32(y);
+    __m256i next_row = _mm256_set1_epi32(y + 1);
+    const int32_t* wall_top = view->wall_top;
+    const int32_t* wall_bottom = view->wall_bottom;
+
+    int width = view->frame.width;
+    int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m256i visible = ceiling ?
+            _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(wall_top + x)), row) :
+            _mm256_cmpgt_epi32(next_row, _mm256_loadu_si256((const __m256i*)(wall_bottom + x)));
+        if(!_mm256_testz_si256(visible, visible)) {
+            __m256i tu = _mm256_and_si256(_mm256_sra_epi32(u, fraction), mask);
+            __m256i tv = _mm256_and_si256(_mm256_sra_epi32(v, fraction), mask);
+            __m256i index = _mm256_or_si256(_mm256_sll_epi32(tu, shift), tv);
+            __m256i texels = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                (const int*)span->texels, index, visible, 4);
+            if(span->shade) texels = shade_avx2(texels, span->shade);
+            _mm256_maskstore_epi32((int*)(out + x), visible, texels);
+        }
+        u = _mm256_add_epi32(u, du);
+        v = _mm256_add_epi32(v, dv);
+    }
+    if(x < width) floor_row_scalar(view, out, y, ceiling, span, x);
+}
+#endif
+
+static void render_floor_rows(void* data, int y_begin, int y_end) {
+    const RenderView* view = data;
+    int screen_width = view->frame.width, screen_height = view->frame.height;
+    float posX = view->camera.posX, posY = view->camera.posY;
+    float dirX = view->camera.dirX, dirY = view->camera.dirY;
+    float planeX = view->camera.planeX, planeY = view->camera.planeY;
+    float rayDirX0 = dirX - planeX, rayDirY0 = dirY - planeY;
+    float rayDirX1 = dirX + planeX, rayDirY1 = dirY + planeY;
+#if defined(__x86_64__) || defined(__i386__)
+    // Follows the ray traversal path, so -s scalar checks both
+    int avx2 = raycast_isa() == RAY_ISA_AVX2;
+#endif
+
+    for(int y = y_begin; y < y_end; y++) {
+        int ceiling = y < screen_height / 2;
+        const Texture* tex = &textures[ceiling ? view->ceiling_texture : view->floor_texture];
+        uint32_t* out = view->frame.pixels + y * screen_width;
+
+        // Distance to the floor seen through this row, sampled at the
+        // row's centre so the horizon row stays finite
+        float p = ceiling ? screen_height / 2 - y - 0.5f : y - screen_height / 2 + 0.5f;
+        float rowDistance = 0.5f * view->view_height / p;
+        const Shade* shade = view->shading ? shade_at(view, rowDistance, 0) : NULL;
+
+        // Only square power-of-two textures can wrap with a mask; anything
+        // else keeps the old flat colours. Rows lost in the fog are flat too.
+        if(tex->shift < 0 || (shade && shade->mul == 0)) {
+            uint32_t color = ceiling ? 0x202020 : 0x404040;
+            if(shade) color = shade_pixel(color, shade);
+            for(int x = 0; x < screen_width; x++) {
+                if(floor_visible(view, x, y, ceiling)) out[x] = color;
+            }
+            continue;
+        }
+        float stepX = rowDistance * (rayDirX1 - rayDirX0) / screen_width;
+        float stepY = rowDistance * (rayDirY1 - rayDirY0) / screen_width;
+        float floorX = posX + rowDistance * rayDirX0;
+        float floorY = posY + rowDistance * rayDirY0;
+
+        // Mip level bringing the texel step per column under two
+        float texels = fmaxf(fabsf(stepX), fabsf(stepY)) * tex->width;
+        int level = 0;
+        while(level + 1 < tex->levels && texels >= (float)(2 << level)) level++;
+
+        // Textures repeat every cell, so only the position within the cell
+        // matters; dropping the whole cells keeps 16.16 in range on any map
+        floorX -= floorf(floorX);
+        floorY -= floorf(floorY);
+
+        FloorSpan span = {
+            tex->mips[level], tex->shift - level,
+            (int32_t)(floorX * 65536.0f), (int32_t)(floorY * 65536.0f),
+            (int32_t)(stepX * 65536.0f), (int32_t)(stepY * 65536.0f),
+            shade
+        };
+#if defined(__x86_64__) || defined(__i386__)
+        if(avx2) {
+            floor_row_avx2(view, out, y, ceiling, &span);
+            continue;
+        }
+#endif
+        floor_row_scalar(view, out, y, ceiling, &span, 0);
+    }
+}
+
+void render_floor(RenderView* view) {
+    PROFILE_BEGIN(ZONE_FLOOR);
+    parallel_for(view->frame.height, FLOOR_TILE_ROWS, render_floor_rows, view);
+#ifdef PROFILE
+    // The floor fills exactly the rows the walls left
+    int64_t wall_pixels = 0;
+    for(int x = 0; x < view->frame.width; x++) wall_pixels += view->wall_bottom[x] - view->wall_top[x];
+    PROFILE_COUNT(COUNTER_PIXELS, (int64_t)view->frame.width * view->frame.height - wall_pixels);
+#endif
+    PROFILE_END(ZONE_FLOOR);
+}
+
+// Screen effects, in the order they apply. Gamma goes last so it corrects
+// the blended result.
+static void register_postfx_passes(RenderView* view) {
+    if(view->flash_pass >= 0) return;
+    view->flash_pass = postfx_add_blend(&view->postfx, 0xFFED29);
+    view->damage_pass = postfx_add_blend(&view->postfx, 0xC00000);
+    view->gamma_pass = postfx_add_gamma(&view->postfx);
+}
+
+void render_set_gamma(RenderView* view, float gamma) {
+    view->gamma_value = gamma > 0.0f ? gamma : 1.0f;
+}
+
+void render_postfx(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_POSTFX);
+    const UIState* ui = &world->ui;
+    PostFx* fx = &view->postfx;
+    register_postfx_passes(view);
+
+    // The pickup flash is a flat 50% blend; the damage tint fades out
+    postfx_set_strength(fx, view->flash_pass, ui->pickup_flash_timer > 0 ? 0.5f : 0.0f);
+    float damage = ui->damage_flash_timer / DAMAGE_FLASH_SECONDS;
+    postfx_set_strength(fx, view->damage_pass, damage > 0 ? 0.6f * (damage < 1 ? damage : 1) : 0.0f);
+    postfx_set_strength(fx, view->gamma_pass, view->gamma_value == 1.0f ? 0.0f : view->gamma_value);
+
+    postfx_apply(fx, view->frame.pixels, view->frame.width * view->frame.height);
+    PROFILE_END(ZONE_POSTFX);
+}
+
+RenderView* render_view_create(int w, int h) {
+    RenderView* view = calloc(1, sizeof(RenderView));
+    if(!view) return NULL;
+    view->interpolation_alpha = 1.0f;
+    view->column_step = 1;
+    view->side_light = 1.0f;
+    view->floor_texture = TEX_WALL;
+    view->ceiling_texture = TEX_WALL;
+    view->flash_pass = view->damage_pass = view->gamma_pass = -1;
+    view->gamma_value = 1.0f;
+    build_shades(view);
+    if(!render_set_resolution(view, w, h)) {
+        render_view_destroy(view);
+        return NULL;
+    }
+    return view;
+}
+
+void render_view_destroy(RenderView* view) {
+    if(!view) return;
+    free(view->zbuffer);
+    free(view->wall_top);
+    free(view->wall_bottom);
+    free(view->sprite_bin_start);
+    free(view->sprite_bin_fill);
+    free(view->sprite_bins);
+    free(view->sprite_spans);
+    free(view->sort_order);
+    free(view->sort_keys);
+    free(view->sort_scratch);
+    surface_free(&view->hud_layer);
+    surface_free(&view->frame);
+    free(view);
+}
+
+int render_set_resolution(RenderView* view, int w, int h) {
+    // Everything is allocated before anything is swapped in, so a failure
+    // leaves the view whole at its old resolution
+    Surface frame = {0}, hud_layer = {0};
+    int ok = surface_resize(&frame, w, h);
+    // The HUD layer is always HUD_ROWS high, above the surface minimum
+    ok = ok && surface_resize(&hud_layer, frame.width, HUD_ROWS);
+    int width = frame.width;
+    int tiles = (width + SPRITE_TILE_COLUMNS - 1) / SPRITE_TILE_COLUMNS;
+    float* zbuffer = ok ? malloc(width * sizeof(float)) : NULL;
+    int32_t* wall_top = ok ? malloc(width * sizeof(int32_t)) : NULL;
+    int32_t* wall_bottom = ok ? malloc(width * sizeof(int32_t)) : NULL;
+    int* bin_start = ok ? malloc((tiles + 1) * sizeof(int)) : NULL;
+    int* bin_fill = ok ? malloc(tiles * sizeof(int)) : NULL;
+    if(!zbuffer || !wall_top || !wall_bottom || !bin_start || !bin_fill) {
+        surface_free(&frame);
+        surface_free(&hud_layer);
+        free(zbuffer);
+        free(wall_top);
+        free(wall_bottom);
+        free(bin_start);
+        free(bin_fill);
+        return 0;
+    }
+
+    surface_free(&view->frame);
+    surface_free(&view->hud_layer);
+    free(view->zbuffer);
+    free(view->wall_top);
+    free(view->wall_bottom);
+    free(view->sprite_bin_start);
+    free(view->sprite_bin_fill);
+    view->frame = frame;
+    view->hud_layer = hud_layer;
+    view->zbuffer = zbuffer;
+    view->wall_top = wall_top;
+    view->wall_bottom = wall_bottom;
+    view->sprite_tiles = tiles;
+    view->sprite_bin_start = bin_start;
+    view->sprite_bin_fill = bin_fill;
+    view->view_height = width * 3 / 4;
+    view->hud_valid = 0;
+    return 1;
+}
+
+const Surface* render_target(const RenderView* view) {
+    return &view->frame;
+}
+
+void render_set_target(RenderView* view, uint32_t* pixels) {
+    surface_set_pixels(&view->frame, pixels);
+}
+
+void render_set_camera(RenderView* view, Camera camera) {
+    view->camera = camera;
+}
+
+void render_set_column_step(RenderView* view, int step) {
+    if(step < 1) step = 1;
+    if(step > MAX_COLUMN_STEP) step = MAX_COLUMN_STEP;
+    view->column_step = step;
+}
+
+int render_column_step(const RenderView* view) {
+    return view->column_step;
+}
+
+// Dynamic resolution. The column step doubles while the average frame is
+// over budget and halves again once a frame would fit with the walls
+// costing twice as much. Each change is left to settle before the next.
+#define COLUMN_STEP_SETTLE_FRAMES 30
+
+void render_set_target_frame_time(RenderView* view, float seconds) {
+    view->target_frame_seconds = seconds > 0.0f ? seconds : 0.0f;
+    view->average_frame_seconds = 0.0f;
+    view->frames_since_step_change = 0;
+}
+
+void render_report_frame_time(RenderView* view, float seconds) {
+    float target = view->target_frame_seconds;
+    if(target <= 0.0f) return;
+
+    if(view->frames_since_step_change == 0) view->average_frame_seconds = seconds;
+    else view->average_frame_seconds += (seconds - view->average_frame_seconds) * 0.1f;
+    if(++view->frames_since_step_change < COLUMN_STEP_SETTLE_FRAMES) return;
+
+    int step = view->column_step;
+    if(view->average_frame_seconds > target && step < MAX_COLUMN_STEP) step *= 2;
+    else if(view->average_frame_seconds < target * 0.6f && step > 1) step /= 2;
+    if(step != view->column_step) {
+        render_set_column_step(view, step);
+        view->frames_since_step_change = 0;
+    }
+}
+
+void render_scene(RenderView* view, const World* world) {
+    PROFILE_BEGIN(ZONE_FRAME);
+    render_walls(view, world);
+    render_floor(view);
+    render_entities(view, world);
+    render_ui(view, world);
+    render_weapon(view, world);
+    render_postfx(view, world);
+    PROFILE_END(ZONE_FRAME);
+    profile_draw_overlay(&view->frame);
+}
+
+struct RenderBatch {
+    RenderView* settings;   // a copy of the caller's, never drawn with
+    int flags;
+    RenderView** views;     // one per entry, kept between batches
+    int view_count;
+    const RenderBatchEntry* entries;
+};
+
+// Everything a view is configured with, leaving its buffers alone
+static void copy_view_settings(RenderView* view, const RenderView* settings) {
+    render_set_column_step(view, settings->column_step);
+    view->fog_enabled = settings->fog_enabled;
+    view->fog_culling = settings->fog_culling;
+    view->fog_color = settings->fog_color;
+    view->fog_start = settings->fog_start;
+    view->fog_end = settings->fog_end;
+    view->side_light = settings->side_light;
+    view->floor_texture = settings->floor_texture;
+    view->ceiling_texture = settings->ceiling_texture;
+    build_shades(view);
+}
+
+RenderBatch* render_batch_create(const RenderView* settings, int flags) {
+    RenderBatch* batch = calloc(1, sizeof(RenderBatch));
+    if(!batch) return NULL;
+    batch->settings = render_view_create(settings->frame.width, settings->frame.height);
+    if(!batch->settings) {
+        free(batch);
+        return NULL;
+    }
+    copy_view_settings(batch->settings, settings);
+    batch->flags = flags;
+    return batch;
+}
+
+void render_batch_destroy(RenderBatch* batch) {
+    if(!batch) return;
+    for(int i = 0; i < batch->view_count; i++) render_view_destroy(batch->views[i]);
+    free(batch->views);
+    render_view_destroy(batch->settings);
+    free(batch);
+}
+
+void render_batch_size(const RenderBatch* batch, int* width, int* height) {
+    *width = batch->settings->frame.width;
+    *height = batch->settings->frame.height;
+}
+
+// Rec. 601 luma in 8-bit fixed point
+static void frame_to_gray(const uint32_t* pixels, uint8_t* out, int count) {
+    for(int i = 0; i < count; i++) {
+        uint32_t p = pixels[i];
+        out[i] = (uint8_t)((((p >> 16) & 0xFF) * 77 + ((p >> 8) & 0xFF) * 150 + (p & 0xFF) * 29) >> 8);
+    }
+}
+
+static void render_batch_entries(void* data, int begin, int end) {
+    RenderBatch* batch = data;
+    int gray = batch->flags & RENDER_BATCH_GRAY;
+    for(int i = begin; i < end; i++) {
+        const RenderBatchEntry* entry = &batch->entries[i];
+        RenderView* view = batch->views[i];
+        if(!gray) render_set_target(view, entry->pixels);
+        view->camera = entry->camera;
+
+        render_walls(view, entry->world);
+        render_floor(view);
+        render_entities(view, entry->world);
+        if(batch->flags & RENDER_BATCH_HUD) render_ui(view, entry->world);
+
+        if(gray) frame_to_gray(view->frame.pixels, entry->pixels, view->frame.width * view->frame.height);
+        else render_set_target(view, NULL);
+    }
+}
+
+int render_batch(RenderBatch* batch, const RenderBatchEntry* entries, int count) {
+    if(count > batch->view_count) {
+        RenderView** views = realloc(batch->views, count * sizeof(RenderView*));
+        if(!views) return 0;
+        batch->views = views;
+        for(; batch->view_count < count; batch->view_count++) {
+            const RenderView* settings = batch->settings;
+            RenderView* view = render_view_create(settings->frame.width, settings->frame.height);
+            if(!view) return 0;
+            copy_view_settings(view, settings);
+            views[batch->view_count] = view;
+        }
+    }
+
+    // A lone entry runs on the caller and keeps each pass's own parallelism
+    batch->entries = entries;
+    parallel_for(count, 1, render_batch_entries, batch);
+    batch->entries = NULL;
+    return 1;
+}
+
+#ifndef HEADLESS
+// Pipelined presentation. Two streaming textures alternate: while the
+// render thread fills one, locked, with this frame, the calling thread
+// unlocks (uploads) and presents the other, holding the previous frame.
+// SDL is only ever called from the calling thread.
+struct Presenter {
+    SDL_Renderer* renderer;
+    RenderView* view;
+    SDL_Texture* textures[2];
+    int width, height;      // of the textures
+    int next;               // texture this frame is drawn into
+    int pending;            // the other one holds a frame still to present
+
+    SDL_Thread* thread;
+    SDL_sem* start;
+    SDL_sem* done;
+    int quit;
+
+    // Work for the render thread
+    const World* world;
+    uint8_t* pixels;
+    int pitch;
+};
+
+static int presenter_thread(void* data) {
+    Presenter* p = data;
+    RenderView* view = p->view;
+    for(;;) {
+        SDL_SemWait(p->start);
+        if(p->quit) break;
+
+        Uint64 render_start = SDL_GetPerformanceCounter();
+        render_scene(view, p->world);
+        render_report_frame_time(view, (float)(SDL_GetPerformanceCounter() - render_start) / SDL_GetPerformanceFrequency());
+
+        // Passes read the frame back (post-FX, stepped columns, glyphs), and
+        // locked texture memory may be write-combined or write-only, so the
+        // frame is drawn in system memory and only ever written out, in
+        // one sequential copy
+        int width = view->frame.width, height = view->frame.height;
+        if(p->pitch == width * (int)sizeof(uint32_t)) {
+            memcpy(p->pixels, view->frame.pixels, (size_t)width * height * sizeof(uint32_t));
+        } else {
+            for(int y = 0; y < height; y++) {
+                memcpy(p->pixels + y * p->pitch, view->frame.pixels + y * width, width * sizeof(uint32_t));
+            }
+        }
+        SDL_SemPost(p->done);
+    }
+    return 0;
+}
+
+static void destroy_present_textures(Presenter* p) {
+    for(int i = 0; i < 2; i++) {
+        if(p->pending && i != p->next) SDL_UnlockTexture(p->textures[i]);
+        if(p->textures[i]) SDL_DestroyTexture(p->textures[i]);
+        p->textures[i] = NULL;
+    }
+    p->pending = 0;
+}
+
+// The textures always match the view's resolution; the renderer scales
+// them to the window. A frame rendered at the old size is dropped.
+static int resize_present_textures(Presenter* p) {
+    destroy_present_textures(p);
+    const Surface* frame = render_target(p->view);
+    for(int i = 0; i < 2; i++) {
+        p->textures[i] = SDL_CreateTexture(p->renderer,
+            SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+            frame->width, frame->height);
+        if(!p->textures[i]) return 0;
+    }
+    p->width = frame->width;
+    p->height = frame->height;
+    p->next = 0;
+    return 1;
+}
+
+Presenter* presenter_create(SDL_Renderer* renderer, RenderView* view) {
+    Presenter* p = calloc(1, sizeof(Presenter));
+    if(!p) return NULL;
+    p->renderer = renderer;
+    p->view = view;
+    p->start = SDL_CreateSemaphore(0);
+    p->done = SDL_CreateSemaphore(0);
+    if(p->start && p->done) p->thread = SDL_CreateThread(presenter_thread, "render", p);
+    if(!p->thread || !resize_present_textures(p)) {
+        presenter_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+void presenter_frame(Presenter* p, const World* world) {
+    const Surface* frame = render_target(p->view);
+    if(p->width != frame->width || p->height != frame->height) {
+        if(!resize_present_textures(p)) return;
+    }
+
+    void* pixels;
+    if(SDL_LockTexture(p->textures[p->next], NULL, &pixels, &p->pitch) != 0) return;
+    p->pixels = pixels;
+    p->world = world;
+    SDL_SemPost(p->start);
+
+    // Upload and present the previous frame while this one renders
+    if(p->pending) {
+        PROFILE_BEGIN(ZONE_UPLOAD);
+        SDL_Texture* previous = p->textures[!p->next];
+        SDL_UnlockTexture(previous);
+        SDL_RenderCopy(p->renderer, previous, NULL, NULL);
+        SDL_RenderPresent(p->renderer);
+        PROFILE_END(ZONE_UPLOAD);
+    }
+
+    SDL_SemWait(p->done);
+    p->pending = 1;
+    p->next = !p->next;
+}
+
+void presenter_destroy(Presenter* p) {
+    if(!p) return;
+    if(p->thread) {
+        p->quit = 1;
+        SDL_SemPost(p->start);
+        SDL_WaitThread(p->thread, NULL);
+    }
+    destroy_present_textures(p);
+    if(p->start) SDL_DestroySemaphore(p->start);
+    if(p->done) SDL_DestroySemaphore(p->done);
+    free(p);
+}
+#endif
@@ -1,45 +1,122 @@
-#ifndef RENDER_H
-#define RENDER_H
-
-#include "map.h"
-#include "graphic.h"
-
-#define MAX_ENTITIES 100
-#define MAX_TEXTURES 2
-
-typedef struct {
-    float x, y;
-    float dx, dy;
-    float move_timer;
-    float distance;
-    int texture_id;
-    int visible;
-    int is_chaser;
-} Entity;
-
-typedef struct {
-    int health;
-    int ammo;
-    int score;
-    int lives;
-    float pickup_flash_timer;
-} UIState;
-
-typedef enum {
-    WEAPON_IDLE,
-    WEAPON_FIRING
-} WeaponState;
-
-extern WeaponState weapon_state;
-
-extern UIState ui;
-
-extern Texture textures[MAX_TEXTURES];
-extern Entity entities[MAX_ENTITIES];
-extern int entity_count;
-
-void init_renderer(SDL_Window* window, SDL_Renderer** renderer, SDL_Texture** texture);
-void render_frame(SDL_Renderer* renderer, SDL_Texture* screen_texture);
-void cleanup_renderer(SDL_Renderer* renderer, SDL_Texture* texture);
-
-#endif
\ No newline at end of file
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "map.h"
+#include "graphic.h"
+#include "entity.h"
+#include "texture.h"
+#include "world.h"
+
+// Everything one renderer owns: the frame it draws into, the per-column
+// and sprite buffers, the camera it draws from and its settings. Views
+// share nothing, so several can draw at once on different threads, each
+// from any world. Every function below takes the view it works on.
+typedef struct RenderView RenderView;
+
+// A view drawing w x h frames (see surface_resize() for the limits);
+// NULL when out of memory
+RenderView* render_view_create(int w, int h);
+void render_view_destroy(RenderView* view);
+
+// Reallocates the frame and every per-column buffer for a w x h frame.
+// Call it between frames, never while one is being drawn. 0 when out of
+// memory, with the view left at its old resolution.
+int render_set_resolution(RenderView* view, int w, int h);
+// The frame, for reading after a render_scene(); its size is the
+// resolution after rounding
+const Surface* render_target(const RenderView* view);
+// Draws into width x height pixels owned by the caller until called again;
+// NULL goes back to the view's own. Passes read the frame back, so the
+// memory must be fast to read, unlike locked texture memory.
+void render_set_target(RenderView* view, uint32_t* pixels);
+
+// Where the frame is drawn from. Usually the world's camera, or one part
+// way between two ticks.
+void render_set_camera(RenderView* view, Camera camera);
+// Where between the previous and the latest simulation tick sprites are
+// drawn, from 0 (entities.prev_x/y) to 1 (entities.x/y, the default)
+void render_set_interpolation(RenderView* view, float alpha);
+
+// Screen columns sharing one wall ray, 1 to 4; floor, sprites and the HUD
+// stay at full resolution
+void render_set_column_step(RenderView* view, int step);
+int render_column_step(const RenderView* view);
+// Dynamic resolution: given a render time budget per frame (0 turns it off),
+// render_report_frame_time() raises or lowers the column step to hold it
+void render_set_target_frame_time(RenderView* view, float seconds);
+void render_report_frame_time(RenderView* view, float seconds);
+
+// Floor and ceiling textures; both default to TEX_WALL. Textures that
+// aren't square powers of two fall back to flat colours.
+void render_set_surfaces(RenderView* view, int floor_id, int ceiling_id);
+
+// Distance fog towards `color`, from none at `start` to solid at `end`
+// (perpendicular distance in cells); end <= start turns it off. Applied
+// by the wall, floor and sprite passes as they draw.
+void render_set_fog(RenderView* view, uint32_t color, float start, float end);
+// Stops wall rays at the fog's end, bounding the DDA walk on open maps
+void render_set_fog_culling(RenderView* view, int enabled);
+// Brightness of y-side walls, 0 to 1; 1 (the default) is no side shading
+void render_set_side_light(RenderView* view, float light);
+// Output gamma, applied as a final post-FX pass; 1 (the default) is off
+void render_set_gamma(RenderView* view, float gamma);
+
+// Individual passes, in the order render_scene() runs them. Walls and the
+// floor between them cover every pixel, so nothing clears the frame.
+void render_walls(RenderView* view, const World* world);
+void render_floor(RenderView* view);
+void render_entities(RenderView* view, const World* world);
+void render_ui(RenderView* view, const World* world);
+void render_weapon(RenderView* view, const World* world);
+void render_postfx(RenderView* view, const World* world);
+
+// Draws a full frame of the world without touching SDL. Drawing never
+// changes the world, however often it happens between ticks.
+void render_scene(RenderView* view, const World* world);
+
+// Batched rendering for agents and other consumers of many small frames.
+// A batch draws any number of camera poses, each against its own world or
+// a shared one, into buffers the caller owns. Views are created once and
+// reused by entry, so allocation, sprite ordering and the thread pool are
+// paid for once per batch rather than per frame; maps and textures are
+// shared as always. Entries are spread across the thread pool, one per
+// task. Frames hold walls, floor and sprites, plus the HUD with
+// RENDER_BATCH_HUD; screen effects and the weapon are left out, as the
+// weapon animates its world.
+enum RENDER_BATCH_FLAGS {
+    RENDER_BATCH_GRAY = 1,  // one luma byte per pixel instead of ARGB
+    RENDER_BATCH_HUD = 2
+};
+
+typedef struct {
+    const World* world;
+    Camera camera;
+    void* pixels;   // width x height uint32_t, or uint8_t in gray
+} RenderBatchEntry;
+
+typedef struct RenderBatch RenderBatch;
+
+// Frames take their resolution and every setting (fog, lighting, column
+// step, surfaces) from `settings`, as it is now; low resolutions are just
+// a small `settings` view. NULL when out of memory.
+RenderBatch* render_batch_create(const RenderView* settings, int flags);
+void render_batch_destroy(RenderBatch* batch);
+// Size of each entry's buffer, in pixels
+void render_batch_size(const RenderBatch* batch, int* width, int* height);
+// Returns once every entry's buffer holds its frame; 0 when out of memory
+int render_batch(RenderBatch* batch, const RenderBatchEntry* entries, int count);
+
+#ifndef HEADLESS
+// Renders and presents a view's frames, pipelined: render_scene() runs on
+// a render thread and the frame is copied into locked texture memory,
+// while the calling thread uploads and presents the previous frame. The
+// window therefore shows each frame one call late. Follows resolution
+// changes made between calls.
+typedef struct Presenter Presenter;
+Presenter* presenter_create(SDL_Renderer* renderer, RenderView* view);
+// Returns once the world has been drawn, so it is free to change again
+void presenter_frame(Presenter* presenter, const World* world);
+void presenter_destroy(Presenter* presenter);
+#endif
+
+#endif
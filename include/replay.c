@@ -0,0 +1,86 @@
+#include "replay.h"
+#include "world.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void replay_init(Replay* replay, const char* map_file, uint32_t seed) {
+    memset(replay, 0, sizeof(*replay));
+    snprintf(replay->map_file, sizeof(replay->map_file), "%s", map_file);
+    replay->seed = seed;
+}
+
+int replay_record(Replay* replay, unsigned input) {
+    if(replay->tick_count == replay->capacity) {
+        int capacity = replay->capacity ? replay->capacity * 2 : 4096;
+        uint8_t* grown = realloc(replay->inputs, capacity);
+        if(!grown) return 0;
+        replay->inputs = grown;
+        replay->capacity = capacity;
+    }
+    replay->inputs[replay->tick_count++] = (uint8_t)input;
+    return 1;
+}
+
+void replay_free(Replay* replay) {
+    free(replay->inputs);
+    memset(replay, 0, sizeof(*replay));
+}
+
+int replay_save(const Replay* replay, const char* filename) {
+    // Held keys repeat the same input for many ticks, so store runs
+    ReplayRun* runs = malloc((replay->tick_count + 1) * sizeof(ReplayRun));
+    if(!runs) return 0;
+    int run_count = 0;
+    for(int t = 0; t < replay->tick_count; t++) {
+        ReplayRun* last = run_count ? &runs[run_count - 1] : NULL;
+        if(last && last->input == replay->inputs[t] && last->ticks < 255) last->ticks++;
+        else runs[run_count++] = (ReplayRun){replay->inputs[t], 1};
+    }
+
+    ReplayFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAY_FILE_MAGIC, 4);
+    header.version = REPLAY_FILE_VERSION;
+    header.tick_rate = TICK_RATE;
+    header.seed = replay->seed;
+    header.tick_count = replay->tick_count;
+    header.run_count = run_count;
+    memcpy(header.map_file, replay->map_file, sizeof(header.map_file));
+
+    FILE* file = fopen(filename, "wb");
+    int ok = file != NULL;
+    if(ok) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(runs, sizeof(ReplayRun), run_count, file) == (size_t)run_count;
+        if(fclose(file) != 0) ok = 0;
+    }
+    free(runs);
+    return ok;
+}
+
+int replay_load(Replay* replay, const char* filename) {
+    memset(replay, 0, sizeof(*replay));
+    FILE* file = fopen(filename, "rb");
+    if(!file) return 0;
+
+    ReplayFileHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+             memcmp(header.magic, REPLAY_FILE_MAGIC, 4) == 0 &&
+             header.version == REPLAY_FILE_VERSION &&
+             header.tick_rate == TICK_RATE;
+    if(ok) {
+        header.map_file[sizeof(header.map_file) - 1] = '\0';
+        replay_init(replay, header.map_file, header.seed);
+    }
+
+    ReplayRun run;
+    for(uint32_t r = 0; r < header.run_count && ok; r++) {
+        ok = fread(&run, sizeof(run), 1, file) == 1 && run.ticks > 0;
+        for(int t = 0; t < run.ticks && ok; t++) ok = replay_record(replay, run.input);
+    }
+    if(ok && replay->tick_count != (int)header.tick_count) ok = 0;
+    fclose(file);
+    if(!ok) replay_free(replay);
+    return ok;
+}
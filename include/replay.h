@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+// A recorded session: the map, the world's seed and the WORLD_INPUT bits
+// of every tick. Worlds are deterministic in those, so creating a world on
+// the map, seeding it, spawning its entities and feeding it the inputs in
+// order plays the session back exactly, at any speed.
+typedef struct {
+    char map_file[64];
+    uint32_t seed;
+    uint8_t* inputs;        // one per tick
+    int tick_count;
+    int capacity;
+} Replay;
+
+// Replay files hold this header, then run_count runs of equal input;
+// fields are little-endian
+#define REPLAY_FILE_MAGIC "RREC"
+#define REPLAY_FILE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t tick_rate;         // TICK_RATE it was recorded at
+    uint32_t seed;
+    uint32_t tick_count;
+    uint32_t run_count;
+    char map_file[64];
+    uint8_t reserved[40];
+} ReplayFileHeader;
+
+typedef struct {
+    uint8_t input;
+    uint8_t ticks;              // 1-255
+} ReplayRun;
+
+// An empty recording of a session on `map_file` seeded with `seed`
+void replay_init(Replay* replay, const char* map_file, uint32_t seed);
+// Appends the next tick's input; 0 when out of memory
+int replay_record(Replay* replay, unsigned input);
+int replay_save(const Replay* replay, const char* filename);
+// 0 when the file is missing, malformed or from another tick rate
+int replay_load(Replay* replay, const char* filename);
+// A zeroed Replay is empty; replay_free() leaves it that way again
+void replay_free(Replay* replay);
+
+#endif
@@ -0,0 +1,17 @@
+#include "scheduler.h"
+#include "thread_pool.h"
+
+static void step_instances(void* data, int begin, int end) {
+    Instance* instances = data;
+    for(int i = begin; i < end; i++) {
+        Instance* instance = &instances[i];
+        world_tick(instance->world, instance->input);
+        if(!instance->view) continue;
+        render_set_camera(instance->view, instance->world->camera);
+        render_scene(instance->view, instance->world);
+    }
+}
+
+void scheduler_step(Instance* instances, int count) {
+    parallel_for(count, 1, step_instances, instances);
+}
@@ -0,0 +1,23 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "world.h"
+#include "render.h"
+
+// One simulation to step: its world, this tick's input (WORLD_INPUT bits)
+// and optionally a view to draw it with
+typedef struct {
+    World* world;
+    unsigned input;
+    RenderView* view;   // NULL to simulate without drawing
+} Instance;
+
+// Ticks every instance once and, where it has a view, draws the world from
+// its camera. Instances run in parallel across the thread pool, one per
+// task; the passes inside each then run serially on that thread, so many
+// small worlds scale with the core count where one large one would split
+// its frame instead; a lone instance keeps its passes' own parallelism.
+// Instances must not share worlds or views.
+void scheduler_step(Instance* instances, int count);
+
+#endif
@@ -0,0 +1,139 @@
+#include "spatial.h"
+#include "entity.h"
+#include "map.h"
+#include "world.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Grid cells are hashed into a table sized by the entity count rather than
+// the map, so rebuilding costs the same on a 64x64 map as on a 1024x1024 one
+static int clamp_cell(int c, int size) {
+    return c < 0 ? 0 : (c >= size ? size - 1 : c);
+}
+
+static int cell_of(const SpatialGrid* grid, float x, float y) {
+    int cx = clamp_cell((int)floorf(x) >> SPATIAL_CELL_SHIFT, grid->grid_x);
+    int cy = clamp_cell((int)floorf(y) >> SPATIAL_CELL_SHIFT, grid->grid_y);
+    return cx * grid->grid_y + cy;
+}
+
+static int bucket_of(const SpatialGrid* grid, int cell) {
+    return (int)(((uint32_t)cell * 2654435761u) >> (32 - grid->bucket_bits));
+}
+
+static int reserve(SpatialGrid* grid, int count) {
+    int bits = 6;
+    while((1 << bits) < count && bits < 24) bits++;
+
+    if(bits != grid->bucket_bits) {
+        int* grown = realloc(grid->bucket_start, ((1 << bits) + 1) * sizeof(int));
+        if(!grown) return 0;
+        grid->bucket_start = grown;
+        grid->bucket_bits = bits;
+    }
+    if(count > grid->item_capacity) {
+        SpatialItem* grown_items = realloc(grid->items, count * sizeof(SpatialItem));
+        if(!grown_items) return 0;
+        grid->items = grown_items;
+        int* grown_cells = realloc(grid->entity_cell, count * sizeof(int));
+        if(!grown_cells) return 0;
+        grid->entity_cell = grown_cells;
+        grid->item_capacity = count;
+    }
+    return 1;
+}
+
+void spatial_rebuild(World* world) {
+    SpatialGrid* grid = &world->spatial;
+    const EntityStore* entities = &world->entities;
+    if(!reserve(grid, entities->count > 0 ? entities->count : 1)) {
+        grid->grid_x = grid->grid_y = 0;
+        return;
+    }
+    int map_height = world->map->height, map_width = world->map->width;
+    grid->grid_x = map_height > 0 ? (map_height + SPATIAL_CELL_SIZE - 1) >> SPATIAL_CELL_SHIFT : 1;
+    grid->grid_y = map_width > 0 ? (map_width + SPATIAL_CELL_SIZE - 1) >> SPATIAL_CELL_SHIFT : 1;
+
+    // Counting sort: size each bucket, prefix sum, then scatter
+    int* bucket_start = grid->bucket_start;
+    int* entity_cell = grid->entity_cell;
+    int buckets = 1 << grid->bucket_bits;
+    memset(bucket_start, 0, (buckets + 1) * sizeof(int));
+    for(int i = 0; i < entities->count; i++) {
+        if(!entity_alive(entities, i)) {
+            entity_cell[i] = -1;
+            continue;
+        }
+        entity_cell[i] = cell_of(grid, entities->x[i], entities->y[i]);
+        bucket_start[bucket_of(grid, entity_cell[i]) + 1]++;
+    }
+    for(int b = 0; b < buckets; b++) bucket_start[b + 1] += bucket_start[b];
+    for(int i = 0; i < entities->count; i++) {
+        if(entity_cell[i] < 0) continue;
+        int slot = bucket_start[bucket_of(grid, entity_cell[i])]++;
+        grid->items[slot].index = i;
+        grid->items[slot].cell = entity_cell[i];
+    }
+    // The scatter advanced every start to the next bucket's; shift them back
+    for(int b = buckets; b > 0; b--) bucket_start[b] = bucket_start[b - 1];
+    bucket_start[0] = 0;
+}
+
+void spatial_free(SpatialGrid* grid) {
+    free(grid->bucket_start);
+    free(grid->items);
+    free(grid->entity_cell);
+    memset(grid, 0, sizeof(*grid));
+}
+
+// Visits the grid cells overlapping the box; `radius` > 0 switches the
+// test from the box to the circle inscribed in it
+static int query(const World* world, float x0, float y0, float x1, float y1, float radius, int* out, int max_out) {
+    const SpatialGrid* grid = &world->spatial;
+    const EntityStore* entities = &world->entities;
+    if(grid->grid_x == 0) return 0;
+
+    int cx0 = clamp_cell((int)floorf(x0) >> SPATIAL_CELL_SHIFT, grid->grid_x);
+    int cx1 = clamp_cell((int)floorf(x1) >> SPATIAL_CELL_SHIFT, grid->grid_x);
+    int cy0 = clamp_cell((int)floorf(y0) >> SPATIAL_CELL_SHIFT, grid->grid_y);
+    int cy1 = clamp_cell((int)floorf(y1) >> SPATIAL_CELL_SHIFT, grid->grid_y);
+    float mx = (x0 + x1) * 0.5f, my = (y0 + y1) * 0.5f;
+    float radius_sq = radius * radius;
+
+    int found = 0;
+    for(int cx = cx0; cx <= cx1; cx++) {
+        for(int cy = cy0; cy <= cy1; cy++) {
+            int cell = cx * grid->grid_y + cy;
+            int b = bucket_of(grid, cell);
+            for(int n = grid->bucket_start[b]; n < grid->bucket_start[b + 1]; n++) {
+                // Other cells hashing to the same bucket are visited on their own turn
+                if(grid->items[n].cell != cell) continue;
+                int i = grid->items[n].index;
+                if(i >= entities->count || !entity_alive(entities, i)) continue;
+
+                float x = entities->x[i], y = entities->y[i];
+                if(radius > 0) {
+                    float dx = x - mx, dy = y - my;
+                    if(dx*dx + dy*dy >= radius_sq) continue;
+                } else if(x < x0 || x > x1 || y < y0 || y > y1) {
+                    continue;
+                }
+
+                if(found < max_out) out[found] = i;
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+int spatial_query_box(const World* world, float x0, float y0, float x1, float y1, int* out, int max_out) {
+    return query(world, x0, y0, x1, y1, 0.0f, out, max_out);
+}
+
+int spatial_query_radius(const World* world, float x, float y, float radius, int* out, int max_out) {
+    if(radius <= 0) return 0;
+    return query(world, x - radius, y - radius, x + radius, y + radius, radius, out, max_out);
+}
@@ -0,0 +1,42 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+// Uniform spatial hash for entity proximity queries. Each grid cell covers
+// SPATIAL_CELL_SIZE x SPATIAL_CELL_SIZE map cells, so a query only looks at
+// the entities near it instead of every entity in the store.
+#define SPATIAL_CELL_SHIFT 2
+#define SPATIAL_CELL_SIZE (1 << SPATIAL_CELL_SHIFT)
+
+typedef struct World World;
+
+typedef struct {
+    int index;  // entity
+    int cell;   // grid cell it was bucketed under
+} SpatialItem;
+
+// One world's grid; a zeroed one is empty
+typedef struct {
+    int grid_x, grid_y;     // grid cells along x (rows) and y (columns)
+    int bucket_bits;
+    int* bucket_start;      // (1 << bucket_bits) + 1 offsets into items
+    SpatialItem* items;     // live entities grouped by bucket
+    int* entity_cell;       // cell of each entity, -1 when dead
+    int item_capacity;
+} SpatialGrid;
+
+// Re-buckets every live entity of the world by its current position.
+// entity_update() calls this after moving them; call it yourself after
+// teleporting or spawning entities between updates.
+void spatial_rebuild(World* world);
+void spatial_free(SpatialGrid* grid);
+
+// Both queries write the indices of matching live entities to `out` and
+// return how many matched, which can be more than `max_out`; only the
+// first `max_out` are written.
+
+// Entities with x0 <= x <= x1 and y0 <= y <= y1
+int spatial_query_box(const World* world, float x0, float y0, float x1, float y1, int* out, int max_out);
+// Entities closer than `radius` to (x, y)
+int spatial_query_radius(const World* world, float x, float y, float radius, int* out, int max_out);
+
+#endif
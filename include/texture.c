@@ -0,0 +1,138 @@
+#include "texture.h"
+#include <stdlib.h>
+#include <string.h>
+
+Texture textures[MAX_TEXTURES];
+int texture_count = 0;
+uint8_t material_textures[256];
+
+static uint32_t* atlas = NULL;
+static size_t atlas_texels = 0;
+
+// Atlas offsets are rounded to 16 texels so every level starts a cache line
+#define ATLAS_ALIGN 16
+
+static int in_atlas(const uint32_t* pixels) {
+    return atlas && pixels >= atlas && pixels < atlas + atlas_texels;
+}
+
+static int log2_size(int size) {
+    int shift = 0;
+    while((1 << shift) < size) shift++;
+    return (1 << shift) == size ? shift : -1;
+}
+
+int texture_load(const char* path) {
+    if(texture_count >= MAX_TEXTURES) return -1;
+
+    Texture tex;
+    memset(&tex, 0, sizeof(tex));
+    if(!load_texture(path, &tex)) return -1;
+
+    tex.levels = 1;
+    tex.shift = tex.width == tex.height ? log2_size(tex.width) : -1;
+    tex.mips[0] = tex.pixels;
+    textures[texture_count] = tex;
+    return texture_count++;
+}
+
+static int is_key(uint32_t color) {
+    return (color & 0xFFFFFF) == 0xFF00FF;
+}
+
+// 2x2 box filter. Magenta marks transparent texels in sprites: a texel
+// that is mostly transparent stays transparent, otherwise only the opaque
+// texels are averaged so no magenta fringe bleeds into the next level.
+static uint32_t downsample(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t texels[4] = {a, b, c, d};
+    uint32_t sum[4] = {0, 0, 0, 0};
+    int opaque = 0;
+
+    for(int i = 0; i < 4; i++) {
+        if(is_key(texels[i])) continue;
+        for(int channel = 0; channel < 4; channel++) {
+            sum[channel] += (texels[i] >> (channel * 8)) & 0xFF;
+        }
+        opaque++;
+    }
+    if(opaque < 3) return 0xFFFF00FF;
+
+    uint32_t color = 0;
+    for(int channel = 0; channel < 4; channel++) {
+        color |= ((sum[channel] + opaque / 2) / opaque) << (channel * 8);
+    }
+    return color;
+}
+
+static void build_level(uint32_t* out, const uint32_t* in, int size) {
+    int in_size = size * 2;
+    for(int y = 0; y < size; y++) {
+        const uint32_t* row0 = in + (y * 2) * in_size;
+        const uint32_t* row1 = row0 + in_size;
+        for(int x = 0; x < size; x++) {
+            out[y * size + x] = downsample(row0[x * 2], row0[x * 2 + 1], row1[x * 2], row1[x * 2 + 1]);
+        }
+    }
+}
+
+static int level_count(const Texture* tex) {
+    if(tex->shift < 0) return 1;
+    return tex->shift + 1 < MAX_MIP_LEVELS ? tex->shift + 1 : MAX_MIP_LEVELS;
+}
+
+static size_t aligned_texels(size_t texels) {
+    return (texels + ATLAS_ALIGN - 1) & ~(size_t)(ATLAS_ALIGN - 1);
+}
+
+int texture_build_atlas() {
+    size_t total = 0;
+    for(int i = 0; i < texture_count; i++) {
+        for(int level = 0; level < level_count(&textures[i]); level++) {
+            total += aligned_texels((size_t)(textures[i].width >> level) * (textures[i].height >> level));
+        }
+    }
+
+    uint32_t* packed = malloc((total ? total : 1) * sizeof(uint32_t));
+    if(!packed) return 0;
+
+    size_t offset = 0;
+    for(int i = 0; i < texture_count; i++) {
+        Texture* tex = &textures[i];
+        int levels = level_count(tex);
+
+        tex->mips[0] = packed + offset;
+        memcpy(tex->mips[0], tex->pixels, (size_t)tex->width * tex->height * sizeof(uint32_t));
+        offset += aligned_texels((size_t)tex->width * tex->height);
+        if(!in_atlas(tex->pixels)) free(tex->pixels);
+
+        for(int level = 1; level < levels; level++) {
+            int size = tex->width >> level;
+            tex->mips[level] = packed + offset;
+            build_level(tex->mips[level], tex->mips[level - 1], size);
+            offset += aligned_texels((size_t)size * size);
+        }
+        tex->pixels = tex->mips[0];
+        tex->levels = levels;
+    }
+
+    free(atlas);
+    atlas = packed;
+    atlas_texels = total;
+    return 1;
+}
+
+void texture_free_all() {
+    for(int i = 0; i < texture_count; i++) {
+        if(!in_atlas(textures[i].pixels)) free(textures[i].pixels);
+    }
+    free(atlas);
+    atlas = NULL;
+    atlas_texels = 0;
+    memset(textures, 0, sizeof(textures));
+    texture_count = 0;
+}
+
+void texture_set_material(int material, int texture_id) {
+    if(material < 0 || material > 255 || texture_id < 0 || texture_id >= texture_count) return;
+    material_textures[material] = texture_id;
+}
@@ -0,0 +1,42 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "graphic.h"
+#include <stdint.h>
+
+#define MAX_TEXTURES 64
+
+// Ids texture_load() hands out for the textures every build loads first
+enum TEXTURE_IDS { TEX_WALL, TEX_ENTITY, TEX_WEAPON, TEX_AMMO };
+
+// Every loaded texture, indexed by the id texture_load() returned. After
+// texture_build_atlas() all of them, mip levels included, live in one
+// allocation, each level starting on a cache line.
+extern Texture textures[MAX_TEXTURES];
+extern int texture_count;
+
+// Wall texture for each map cell value, texture 0 unless set otherwise
+extern uint8_t material_textures[256];
+
+// Returns the new texture's id, or -1
+int texture_load(const char* path);
+// Packs every texture into the atlas and builds the mip chains. Call again
+// after loading more textures.
+int texture_build_atlas();
+void texture_free_all();
+
+void texture_set_material(int material, int texture_id);
+
+static inline const Texture* texture_for_material(int material) {
+    return &textures[material_textures[material & 0xFF]];
+}
+
+// Level whose texels come closest to one per screen pixel when the texture
+// is stretched across `pixels` screen pixels
+static inline int texture_mip_level(const Texture* tex, int pixels) {
+    int level = 0;
+    while(level + 1 < tex->levels && ((int64_t)pixels << (level + 1)) <= tex->width) level++;
+    return level;
+}
+
+#endif
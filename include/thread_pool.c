@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_POOL_THREADS 64
+
+// Tile range still owned by one worker, packed as (front << 32 | back)
+// so the owner and thieves can both claim tiles with a single CAS.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+} TileQueue;
+
+static pthread_t workers[MAX_POOL_THREADS];
+static TileQueue queues[MAX_POOL_THREADS];
+static int pool_size = 1;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static unsigned job_generation = 0;
+static int workers_busy = 0;
+static int shutting_down = 0;
+
+static job_func job_fn;
+static void* job_data;
+static int job_count;
+static int job_grain;
+
+static _Thread_local int in_job = 0;
+
+int cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static uint64_t pack_range(uint32_t front, uint32_t back) {
+    return ((uint64_t)front << 32) | back;
+}
+
+static int pop_front(TileQueue* q) {
+    uint64_t r = atomic_load(&q->range);
+    for(;;) {
+        uint32_t front = r >> 32, back = (uint32_t)r;
+        if(front >= back) return -1;
+        if(atomic_compare_exchange_weak(&q->range, &r, pack_range(front + 1, back))) {
+            return front;
+        }
+    }
+}
+
+static int steal_back(TileQueue* q) {
+    uint64_t r = atomic_load(&q->range);
+    for(;;) {
+        uint32_t front = r >> 32, back = (uint32_t)r;
+        if(front >= back) return -1;
+        if(atomic_compare_exchange_weak(&q->range, &r, pack_range(front, back - 1))) {
+            return back - 1;
+        }
+    }
+}
+
+static void run_tile(int tile) {
+    int begin = tile * job_grain;
+    int end = begin + job_grain;
+    if(end > job_count) end = job_count;
+    job_fn(job_data, begin, end);
+}
+
+static void work(int self) {
+    int tile;
+    in_job = 1;
+    while((tile = pop_front(&queues[self])) >= 0) run_tile(tile);
+
+    // Own run is empty, help whoever still has tiles left
+    for(int i = 1; i < pool_size; i++) {
+        TileQueue* victim = &queues[(self + i) % pool_size];
+        while((tile = steal_back(victim)) >= 0) run_tile(tile);
+    }
+    in_job = 0;
+}
+
+static void* worker_main(void* arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    for(;;) {
+        while(job_generation == seen && !shutting_down) {
+            pthread_cond_wait(&job_ready, &pool_lock);
+        }
+        if(shutting_down) break;
+        seen = job_generation;
+        pthread_mutex_unlock(&pool_lock);
+
+        work(self);
+
+        pthread_mutex_lock(&pool_lock);
+        if(--workers_busy == 0) pthread_cond_signal(&job_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+int thread_pool_init(int threads) {
+    thread_pool_shutdown();
+
+    if(threads <= 0) threads = cpu_count();
+    if(threads > MAX_POOL_THREADS) threads = MAX_POOL_THREADS;
+
+    shutting_down = 0;
+    job_generation = 0;
+    pool_size = 1;
+    for(int i = 1; i < threads; i++) {
+        if(pthread_create(&workers[i], NULL, worker_main, (void*)(intptr_t)i) != 0) break;
+        pool_size++;
+    }
+    return pool_size;
+}
+
+void thread_pool_shutdown() {
+    if(pool_size <= 1) return;
+
+    pthread_mutex_lock(&pool_lock);
+    shutting_down = 1;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    for(int i = 1; i < pool_size; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pool_size = 1;
+}
+
+int thread_pool_size() {
+    return pool_size;
+}
+
+void parallel_for(int count, int grain, job_func fn, void* data) {
+    if(count <= 0) return;
+    if(grain < 1) grain = 1;
+
+    int tiles = (count + grain - 1) / grain;
+    if(pool_size <= 1 || tiles <= 1 || in_job) {
+        fn(data, 0, count);
+        return;
+    }
+
+    job_fn = fn;
+    job_data = data;
+    job_count = count;
+    job_grain = grain;
+
+    // Hand every worker an equal contiguous run of tiles up front
+    for(int i = 0; i < pool_size; i++) {
+        uint32_t front = (uint32_t)((int64_t)tiles * i / pool_size);
+        uint32_t back = (uint32_t)((int64_t)tiles * (i + 1) / pool_size);
+        atomic_store(&queues[i].range, pack_range(front, back));
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    workers_busy = pool_size - 1;
+    job_generation++;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    work(0);
+
+    pthread_mutex_lock(&pool_lock);
+    while(workers_busy > 0) pthread_cond_wait(&job_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,20 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Callback for one tile of work, covering items [begin, end)
+typedef void (*job_func)(void* data, int begin, int end);
+
+int cpu_count();
+
+// threads <= 0 picks one per CPU; 1 runs every job on the caller
+int thread_pool_init(int threads);
+void thread_pool_shutdown();
+int thread_pool_size();
+
+// Splits [0, count) into tiles of `grain` items and runs them across the
+// pool. Each worker starts on its own contiguous run of tiles and steals
+// from the back of the others once it runs dry. Returns when all tiles are
+// done. Calls made from inside a job run serially on that thread.
+void parallel_for(int count, int grain, job_func fn, void* data);
+
+#endif
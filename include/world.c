@@ -0,0 +1,167 @@
+#include "world.h"
+#include "texture.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+World* world_create(const Map* map) {
+    World* world = calloc(1, sizeof(World));
+    if(!world) return NULL;
+    world->map = map;
+    world->camera = map->spawn;
+    world->stream = (MapStreamWindow){-1, -1};
+    world->ui = (UIState){100, 30, 0, 3, 0.0f, 0.0f};
+    world->weapon_state = WEAPON_IDLE;
+    world_seed(world, WORLD_DEFAULT_SEED);
+    return world;
+}
+
+void world_destroy(World* world) {
+    if(!world) return;
+    entity_store_free(&world->entities);
+    spatial_free(&world->spatial);
+    free(world);
+}
+
+void world_seed(World* world, uint32_t seed) {
+    // Mixed so that nearby seeds start far apart; xorshift never leaves 0
+    uint32_t state = seed * 2654435761u ^ 0x6D2B79F5u;
+    world->random_state = state ? state : 1;
+}
+
+uint32_t world_random(World* world) {
+    uint32_t x = world->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    world->random_state = x;
+    return x;
+}
+
+void world_spawn_entities(World* world) {
+    EntityStore* entities = &world->entities;
+    int map_width = world->map->width, map_height = world->map->height;
+
+    // Regular entities
+    for(int i = 0; i < 4; i++) {
+        EntityHandle handle = entity_spawn(entities, (Entity){
+            .x = (world_random(world) % (map_height-2)) + 1.5f,
+            .y = (world_random(world) % (map_width-2)) + 1.5f,
+            .texture_id = TEX_ENTITY,
+            .visible = 1
+        });
+        entity_randomize_direction(world, entity_index(entities, handle));
+    }
+
+    int ammo = world_random(world) % map_height;
+    for(int i = 0; i < ammo; i++) {
+        entity_spawn(entities, (Entity){
+            .x = (world_random(world) % (map_height-2)) + 1.5f,
+            .y = (world_random(world) % (map_width-2)) + 1.5f,
+            .dx = 0.0f,
+            .dy = 0.0f,
+            .texture_id = TEX_AMMO,
+            .visible = 1,
+            .is_static = 1
+        });
+    }
+    
+    // Chaser entity
+    entity_spawn(entities, (Entity){
+        .x = 5.5f,
+        .y = 5.5f,
+        .texture_id = TEX_ENTITY,
+        .visible = 1,
+        .is_chaser = 1  // Mark as chaser
+    });
+    spatial_rebuild(world);
+}
+
+void world_damage_player(World* world, int damage) {
+    world->ui.health -= damage;
+    if(world->ui.health < 0) world->ui.health = 0;
+    world->ui.damage_flash_timer = DAMAGE_FLASH_SECONDS;
+}
+
+// Steps the player along its facing, one axis at a time so walls can be
+// slid along
+static void move_player(World* world, float moveSpeed) {
+    const Map* map = world->map;
+    Camera* c = &world->camera;
+    float newPosX = c->posX + c->dirX * moveSpeed;
+    float newPosY = c->posY + c->dirY * moveSpeed;
+    if(newPosX >= 0 && newPosX < map->width && newPosY >= 0 && newPosY < map->height) {
+        if(!map_is_solid(map, (int)newPosX, (int)c->posY)) c->posX = newPosX;
+        if(!map_is_solid(map, (int)c->posX, (int)newPosY)) c->posY = newPosY;
+    }
+}
+
+static void turn_player(World* world, float rotSpeed) {
+    Camera* c = &world->camera;
+    float oldDirX = c->dirX;
+    c->dirX = c->dirX * cos(rotSpeed) - c->dirY * sin(rotSpeed);
+    c->dirY = oldDirX * sin(rotSpeed) + c->dirY * cos(rotSpeed);
+    float oldPlaneX = c->planeX;
+    c->planeX = c->planeX * cos(rotSpeed) - c->planeY * sin(rotSpeed);
+    c->planeY = oldPlaneX * sin(rotSpeed) + c->planeY * cos(rotSpeed);
+}
+
+// Firing animation: WEAPON_FRAMES frames of WEAPON_FRAME_TICKS ticks each
+static void advance_weapon(World* world) {
+    if(world->weapon_state != WEAPON_FIRING) return;
+    if(++world->weapon_timer < WEAPON_FRAME_TICKS) return;
+    world->weapon_timer = 0;
+    if(++world->weapon_frame >= WEAPON_FRAMES) {
+        world->weapon_frame = 0;
+        world->weapon_state = WEAPON_IDLE;
+    }
+}
+
+void world_tick(World* world, unsigned input) {
+    PROFILE_BEGIN(ZONE_TICK);
+    float moveSpeed = input & INPUT_RUN ? 0.1f : 0.05f;
+    float rotSpeed = 0.03f;
+    UIState* ui = &world->ui;
+
+    // Flashes fade before this tick can restart them
+    if(ui->pickup_flash_timer > 0) ui->pickup_flash_timer -= TICK_SECONDS;
+    if(ui->damage_flash_timer > 0) ui->damage_flash_timer -= TICK_SECONDS;
+
+    if((input & INPUT_FIRE) && world->weapon_state != WEAPON_FIRING) {
+        world->weapon_state = WEAPON_FIRING;
+        ui->ammo -= 1;
+        if(ui->ammo < 0) {
+            ui->ammo = 0;
+            world->weapon_state = WEAPON_IDLE;
+        }
+    }
+    advance_weapon(world);
+
+    // Movement with collision
+    if(input & INPUT_FORWARD) move_player(world, moveSpeed);
+    if(input & INPUT_BACK) move_player(world, -moveSpeed);
+
+    // Rotation
+    if(input & INPUT_TURN_RIGHT) turn_player(world, rotSpeed);
+    if(input & INPUT_TURN_LEFT) turn_player(world, -rotSpeed);
+
+    map_stream(world->map, &world->stream, world->camera.posX, world->camera.posY);
+
+    // Update entities
+    entity_update(world, TICK_SECONDS);
+
+    int nearby[64];
+    int found = spatial_query_radius(world, world->camera.posX, world->camera.posY, 0.7f, nearby, 64); // Pickup radius
+    for(int n = 0; n < found && n < 64; n++) {
+        int i = nearby[n];
+        if(entity_visible(&world->entities, i) && world->entities.texture_id[i] == TEX_AMMO) {
+            ui->ammo += 15;
+            world->entities.flags[i] &= ~ENTITY_VISIBLE; // Remove pickup
+            ui->score += 50;
+
+            ui->pickup_flash_timer = 0.3f; // 0.3 seconds of flash
+        }
+    }
+    PROFILE_END(ZONE_TICK);
+}
@@ -0,0 +1,85 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "map.h"
+#include "entity.h"
+#include "spatial.h"
+
+// The simulation runs at a fixed rate, so every speed in world_tick() and
+// entity.c is per tick
+#define TICK_RATE 60
+#define TICK_SECONDS (1.0 / TICK_RATE)
+
+// Seed of a fresh world; see world_seed()
+#define WORLD_DEFAULT_SEED 1
+
+typedef struct {
+    int health;
+    int ammo;
+    int score;
+    int lives;
+    float pickup_flash_timer;
+    float damage_flash_timer;   // seconds of red tint left, fading out
+} UIState;
+
+#define DAMAGE_FLASH_SECONDS 0.5f
+
+// The weapon texture holds WEAPON_FRAMES 64x64 frames in a row
+#define WEAPON_FRAMES 5
+#define WEAPON_FRAME_TICKS 5
+
+typedef enum {
+    WEAPON_IDLE,
+    WEAPON_FIRING
+} WeaponState;
+
+// Player input for one tick, as bits
+enum WORLD_INPUT {
+    INPUT_FORWARD = 1,
+    INPUT_BACK = 2,
+    INPUT_TURN_LEFT = 4,
+    INPUT_TURN_RIGHT = 8,
+    INPUT_RUN = 16,
+    INPUT_FIRE = 32     // a new trigger pull, not a held button
+};
+
+// One running game: everything that changes as it is played. Assets are
+// shared rather than owned: the map is only read, through `map`, and
+// textures live in texture.h's table. Worlds touch nothing global, so any
+// number of them can be stepped and drawn at once, each on its own thread
+// (see scheduler.h). Randomness comes from the world's own generator, so a
+// world's seed and its inputs per tick decide everything it does.
+struct World {
+    const Map* map;
+    Camera camera;
+    MapStreamWindow stream;
+    EntityStore entities;
+    SpatialGrid spatial;
+    UIState ui;
+    WeaponState weapon_state;
+    int weapon_frame;       // firing animation frame
+    int weapon_timer;       // ticks into the current animation frame
+    uint32_t random_state;  // see world_random()
+};
+
+// A world on `map` with the player at its spawn and no entities; NULL when
+// out of memory. The map must outlive it.
+World* world_create(const Map* map);
+void world_destroy(World* world);
+
+// Restarts the world's random sequence. Seed before spawning, so the
+// spawns are part of the sequence too.
+void world_seed(World* world, uint32_t seed);
+// The next number of the world's sequence (xorshift32)
+uint32_t world_random(World* world);
+
+// The game's starting set: wanderers, ammo pickups and one chaser
+void world_spawn_entities(World* world);
+
+// Advances the game by one fixed tick: player movement from `input`
+// (WORLD_INPUT bits), entities and pickups
+void world_tick(World* world, unsigned input);
+
+void world_damage_player(World* world, int damage);
+
+#endif
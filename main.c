@@ -1,265 +1,261 @@
-#include "include/graphic.h"
-#include "include/map.h"
-#include "include/render.h"
-#include <SDL2/SDL.h>
-#include <math.h>
-#include <stdlib.h>
-
-enum TEXTURE_IDS { TEX_WALL, TEX_ENTITY, TEX_WEAPON, TEX_AMMO };
-UIState ui = {100, 30, 0, 3};
-
-void randomize_entity_direction(Entity* e) {
-    float angle = (rand() % 360) * (M_PI / 180.0f);
-    float speed = 0.02f; // Adjust movement speed
-    e->dx = cos(angle) * speed;
-    e->dy = sin(angle) * speed;
-    e->move_timer = (rand() % 100) / 20.0f + 1.0f; // 1-6 seconds
-}
-
-void move_entity(Entity* e) {
-    float new_x = e->x + e->dx;
-    float new_y = e->y + e->dy;
-    
-    // Check X movement
-    if(world_map[(int)new_x][(int)e->y] == 0) {
-        e->x = new_x;
-    } else {
-        e->dx *= -1; // Bounce off wall
-    }
-    
-    // Check Y movement
-    if(world_map[(int)e->x][(int)new_y] == 0) {
-        e->y = new_y;
-    } else {
-        e->dy *= -1; // Bounce off wall
-    }
-}
-
-void chase_player(Entity* e) {
-    float chase_speed = 0.03f;
-    float dx = posX - e->x;
-    float dy = posY - e->y;
-    float dist = sqrtf(dx*dx + dy*dy);
-    
-    if(dist > 1.5f) { // Stop when close
-        // Normalize direction
-        float inv_dist = 1.0f / dist;
-        e->dx = dx * inv_dist * chase_speed;
-        e->dy = dy * inv_dist * chase_speed;
-        
-        // Move with collision check
-        float new_x = e->x + e->dx;
-        float new_y = e->y + e->dy;
-        
-        if(world_map[(int)new_x][(int)e->y] == 0) e->x = new_x;
-        if(world_map[(int)e->x][(int)new_y] == 0) e->y = new_y;
-    }
-}
-
-void init_entities() {
-    // Regular entities
-    for(int i = 0; i < 4; i++) {
-        entities[entity_count] = (Entity){
-            .x = (rand() % (map_height-2)) + 1.5f,
-            .y = (rand() % (map_width-2)) + 1.5f,
-            .texture_id = TEX_ENTITY,
-            .visible = 1
-        };
-        randomize_entity_direction(&entities[entity_count]);
-        entity_count++;
-    }
-
-    for(int i = 0; i < rand() % map_height; i++) {
-        entities[entity_count] = (Entity){
-            .x = (rand() % (map_height-2)) + 1.5f,
-            .y = (rand() % (map_width-2)) + 1.5f,
-            .dx = 0.0f,
-            .dy = 0.0f,
-            .texture_id = TEX_AMMO,
-            .visible = 1
-        };
-        entity_count++;
-    }
-    
-    // Chaser entity
-    entities[entity_count] = (Entity){
-        .x = 5.5f,
-        .y = 5.5f,
-        .texture_id = TEX_ENTITY,
-        .visible = 1,
-        .is_chaser = 1  // Mark as chaser
-    };
-    entity_count++;
-}
-
-void player_take_damage(int damage) {
-    ui.health -= damage;
-    if(ui.health < 0) ui.health = 0;
-}
-
-void player_add_score(int points) {
-    ui.score += points;
-}
-
-int main(int argc, char* argv[]) {
-    SDL_Init(SDL_INIT_VIDEO);
-    SDL_Window* window = SDL_CreateWindow("Demo", 
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        SCREEN_WIDTH*2, SCREEN_HEIGHT*2,0);
-
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-    SDL_Texture* screen_texture = SDL_CreateTexture(renderer, 
-        SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 
-        SCREEN_WIDTH, SCREEN_HEIGHT);
-
-    if (!load_map("demo.map")) {
-        SDL_Log("Failed to load map!");
-        return 1;
-    }
-
-    if (!load_texture("texture/wall.bmp", &textures[TEX_WALL]) || 
-        !load_texture("texture/entity.bmp", &textures[TEX_ENTITY]) ||
-        !load_texture("texture/weapon.bmp", &textures[TEX_WEAPON]) ||
-        !load_texture("texture/ammo.bmp", &textures[TEX_AMMO])) {
-        SDL_Log("Failed to load textures!");
-        return 1;
-    }
-    init_entities();
-
-    Uint32 last_time = SDL_GetTicks();
-    int running = 1;
-    
-    while(running) {
-        SDL_Event event;
-        while(SDL_PollEvent(&event)) {
-            if(event.type == SDL_QUIT) {
-                running = 0;
-            }
-            else if(event.type == SDL_KEYDOWN) {
-                // Fullscreen toggle
-                if(event.key.keysym.sym == SDLK_F1) {
-                    Uint32 flags = SDL_GetWindowFlags(window);
-                    if(flags & SDL_WINDOW_FULLSCREEN_DESKTOP) {
-                        SDL_SetWindowFullscreen(window, 0);
-                    } else {
-                        SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
-                    }
-                }
-
-                if(event.key.keysym.sym == SDLK_LCTRL || event.key.keysym.sym == SDLK_RCTRL && weapon_state != WEAPON_FIRING) {
-                    weapon_state = WEAPON_FIRING;
-                    ui.ammo -= 1;
-                    if(ui.ammo < 0) {
-                        ui.ammo = 0;
-                        weapon_state = WEAPON_IDLE;
-                    }
-                }
-            }
-        }
-
-        // Handle input with collision detection
-        const Uint8* keys = SDL_GetKeyboardState(NULL);
-        float delta_time = (SDL_GetTicks() - last_time) / 1000.0f;
-        float moveSpeed = 0.05f;
-        float rotSpeed = 0.03f;
-
-        if(keys[SDL_SCANCODE_LSHIFT]) {
-            moveSpeed += 0.05f;
-        } else {
-            moveSpeed = 0.05f;
-        }
-        
-        // Movement with collision
-        if(keys[SDL_SCANCODE_UP]) {
-            float newPosX = posX + dirX * moveSpeed;
-            float newPosY = posY + dirY * moveSpeed;
-            if(newPosX >= 0 && newPosX < map_width && newPosY >= 0 && newPosY < map_height) {
-                if(world_map[(int)newPosX][(int)posY] == 0) posX = newPosX;
-                if(world_map[(int)posX][(int)newPosY] == 0) posY = newPosY;
-            }
-        }
-        if(keys[SDL_SCANCODE_DOWN]) {
-            float newPosX = posX - dirX * moveSpeed;
-            float newPosY = posY - dirY * moveSpeed;
-            if(newPosX >= 0 && newPosX < map_width && newPosY >= 0 && newPosY < map_height) {
-                if(world_map[(int)newPosX][(int)posY] == 0) posX = newPosX;
-                if(world_map[(int)posX][(int)newPosY] == 0) posY = newPosY;
-            }
-        }
-        
-        // Rotation
-        if(keys[SDL_SCANCODE_RIGHT]) {
-            float oldDirX = dirX;
-            dirX = dirX * cos(rotSpeed) - dirY * sin(rotSpeed);
-            dirY = oldDirX * sin(rotSpeed) + dirY * cos(rotSpeed);
-            float oldPlaneX = planeX;
-            planeX = planeX * cos(rotSpeed) - planeY * sin(rotSpeed);
-            planeY = oldPlaneX * sin(rotSpeed) + planeY * cos(rotSpeed);
-        }
-        if(keys[SDL_SCANCODE_LEFT]) {
-            float oldDirX = dirX;
-            dirX = dirX * cos(-rotSpeed) - dirY * sin(-rotSpeed);
-            dirY = oldDirX * sin(-rotSpeed) + dirY * cos(-rotSpeed);
-            float oldPlaneX = planeX;
-            planeX = planeX * cos(-rotSpeed) - planeY * sin(-rotSpeed);
-            planeY = oldPlaneX * sin(-rotSpeed) + planeY * cos(-rotSpeed);
-        }
-
-        // Update entities
-        for(int i = 0; i < entity_count; i++) {
-            // Skip movement logic for ammo pickups
-            if(entities[i].texture_id == TEX_AMMO) continue;
-
-            if(entities[i].is_chaser) {
-                chase_player(&entities[i]);
-            } else {
-                entities[i].move_timer -= delta_time;
-                if(entities[i].move_timer <= 0) {
-                    randomize_entity_direction(&entities[i]);
-                }
-                move_entity(&entities[i]);
-            }
-
-            // Keep within bounds (for moving entities only)
-            entities[i].x = fmax(1.1f, fmin(map_height-1.1f, entities[i].x));
-            entities[i].y = fmax(1.1f, fmin(map_width-1.1f, entities[i].y));
-        }
-
-        for(int i = 0; i < entity_count; i++) {
-            if(entities[i].texture_id == TEX_AMMO && entities[i].visible) {
-                float dx = entities[i].x - posX;
-                float dy = entities[i].y - posY;
-                float dist = sqrtf(dx*dx + dy*dy);
-        
-                if(dist < 0.7f) { // Pickup radius
-                    ui.ammo += 15;
-                    entities[i].visible = 0; // Remove pickup
-                    player_add_score(50);
-
-                    ui.pickup_flash_timer = 0.3f; // 0.3 seconds of flash
-                }
-            }
-        }
-
-        // Update SDL texture
-        render_frame(renderer, screen_texture);
-
-        // Frame rate control
-        Uint32 current_time = SDL_GetTicks();
-        if(current_time - last_time < 16) SDL_Delay(16 - (current_time - last_time));
-        last_time = current_time;
-    }
-
-    for(int i = 0; i < MAX_TEXTURES; i++) {
-        free(textures[i].pixels);
-    }
-
-    free_map();
-
-    SDL_DestroyTexture(screen_texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-    return 0;
+#include "include/graphic.h"
+#include "include/map.h"
+#include "include/render.h"
+#include "include/thread_pool.h"
+#include "include/spatial.h"
+#include "include/world.h"
+#include "include/profile.h"
+#include "include/replay.h"
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+// Real time simulated per frame at most, so a long stall drops time
+// instead of leaving the loop running ticks to catch up
+#define MAX_FRAME_SECONDS 0.25
+
+// Internal resolutions F2 cycles through
+static const struct { int w, h; } resolutions[] = {
+    {320, 240}, {640, 480}, {960, 540}, {1280, 720}, {1920, 1080}
+};
+#define RESOLUTION_COUNT ((int)(sizeof(resolutions) / sizeof(resolutions[0])))
+
+static Map map;
+static Replay replay;
+
+// Rotation per tick is small enough that blending the direction and plane
+// vectors linearly is indistinguishable from rotating them
+Camera lerp_camera(Camera a, Camera b, float t) {
+    return (Camera){
+        a.posX + (b.posX - a.posX) * t,
+        a.posY + (b.posY - a.posY) * t,
+        a.dirX + (b.dirX - a.dirX) * t,
+        a.dirY + (b.dirY - a.dirY) * t,
+        a.planeX + (b.planeX - a.planeX) * t,
+        a.planeY + (b.planeY - a.planeY) * t
+    };
+}
+
+// Held keys as WORLD_INPUT bits
+unsigned read_input(const Uint8* keys) {
+    unsigned input = 0;
+    if(keys[SDL_SCANCODE_UP]) input |= INPUT_FORWARD;
+    if(keys[SDL_SCANCODE_DOWN]) input |= INPUT_BACK;
+    if(keys[SDL_SCANCODE_LEFT]) input |= INPUT_TURN_LEFT;
+    if(keys[SDL_SCANCODE_RIGHT]) input |= INPUT_TURN_RIGHT;
+    if(keys[SDL_SCANCODE_LSHIFT]) input |= INPUT_RUN;
+    return input;
+}
+
+// usage: main [-r WIDTHxHEIGHT] [-d milliseconds] [-g gamma] [-F distance] [-T trace.json]
+//             [-S seed] [-R out.rec] [-P in.rec]
+//   -r  internal resolution (default 320x240)
+//   -d  render time budget per frame, scaling the wall resolution to hold it
+//   -g  output gamma (default 1)
+//   -F  distance at which the fog is solid, 0 for none (default 32)
+//   -T  write a Chrome trace of the session on exit (PROFILE=1 builds)
+//   -S  world seed (default: the time)
+//   -R  record the session's inputs, written on exit
+//   -P  play a recorded session back instead of reading the keyboard; bench
+//       -R replays one headless, as fast as it renders
+int main(int argc, char* argv[]) {
+    int width = DEFAULT_SCREEN_WIDTH, height = DEFAULT_SCREEN_HEIGHT;
+    float fog_distance = 32.0f;
+    float frame_budget = 0.0f, gamma = 1.0f;
+    const char* trace_file = NULL;
+    const char* record_file = NULL;
+    const char* play_file = NULL;
+    uint32_t seed = (uint32_t)time(NULL);
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "-r") == 0) sscanf(argv[i + 1], "%dx%d", &width, &height);
+        else if(strcmp(argv[i], "-d") == 0) frame_budget = atof(argv[i + 1]) / 1000.0f;
+        else if(strcmp(argv[i], "-g") == 0) gamma = atof(argv[i + 1]);
+        else if(strcmp(argv[i], "-F") == 0) fog_distance = atof(argv[i + 1]);
+        else if(strcmp(argv[i], "-T") == 0) trace_file = argv[i + 1];
+        else if(strcmp(argv[i], "-S") == 0) seed = strtoul(argv[i + 1], NULL, 10);
+        else if(strcmp(argv[i], "-R") == 0) record_file = argv[i + 1];
+        else if(strcmp(argv[i], "-P") == 0) play_file = argv[i + 1];
+    }
+    RenderView* view = render_view_create(width, height);
+    if(!view) {
+        SDL_Log("Failed to allocate the framebuffer!");
+        return 1;
+    }
+    render_set_target_frame_time(view, frame_budget);
+    render_set_gamma(view, gamma);
+    // Darker y-sides, and black fog that also stops rays once they are lost in it
+    render_set_side_light(view, 0.75f);
+    render_set_fog(view, 0x000000, fog_distance * 0.25f, fog_distance);
+    render_set_fog_culling(view, 1);
+
+    // Small resolutions get an integer-scaled window at least 640 wide
+    width = render_target(view)->width;
+    height = render_target(view)->height;
+    int window_scale = width < 640 ? (640 + width - 1) / width : 1;
+
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Window* window = SDL_CreateWindow("Demo", 
+        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+        width*window_scale, height*window_scale, SDL_WINDOW_RESIZABLE);
+
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+    // A replay brings its own map and seed
+    if(play_file) {
+        if(!replay_load(&replay, play_file)) {
+            SDL_Log("Failed to load replay %s!", play_file);
+            return 1;
+        }
+    } else {
+        replay_init(&replay, "demo.map", seed);
+    }
+
+    if (!load_map(&map, replay.map_file)) {
+        SDL_Log("Failed to load map!");
+        return 1;
+    }
+
+    if (texture_load("texture/wall.bmp") != TEX_WALL ||
+        texture_load("texture/entity.bmp") != TEX_ENTITY ||
+        texture_load("texture/weapon.bmp") != TEX_WEAPON ||
+        texture_load("texture/ammo.bmp") != TEX_AMMO) {
+        SDL_Log("Failed to load textures!");
+        return 1;
+    }
+    // Optional wall textures for map cells 2-9, texture/wall2.bmp and on;
+    // cells without one use texture/wall.bmp
+    for(int material = 2; material <= 9; material++) {
+        char path[64];
+        snprintf(path, sizeof(path), "texture/wall%d.bmp", material);
+        texture_set_material(material, texture_load(path));
+    }
+    // Floor and ceiling default to the wall texture
+    render_set_surfaces(view, texture_load("texture/floor.bmp"), texture_load("texture/ceiling.bmp"));
+    texture_build_atlas();
+
+    World* world = world_create(&map);
+    if(!world) {
+        SDL_Log("Failed to create the world!");
+        return 1;
+    }
+    world_seed(world, replay.seed);
+    world_spawn_entities(world);
+    thread_pool_init(0);
+
+    // Renders on its own thread while this one presents the previous frame
+    Presenter* presenter = presenter_create(renderer, view);
+    if(!presenter) {
+        SDL_Log("Failed to start the render thread!");
+        return 1;
+    }
+
+    Uint64 counter_frequency = SDL_GetPerformanceFrequency();
+    Uint64 last_counter = SDL_GetPerformanceCounter();
+    double accumulator = 0.0;
+    Camera previous_camera = world->camera;
+    unsigned pending_input = 0;     // key presses for the next tick
+    int tick = 0;
+    int recording = record_file && !play_file;
+    int profile_overlay = 0;
+    int running = 1;
+    
+    while(running) {
+        SDL_Event event;
+        while(SDL_PollEvent(&event)) {
+            if(event.type == SDL_QUIT) {
+                running = 0;
+            }
+            else if(event.type == SDL_KEYDOWN) {
+                // Fullscreen toggle
+                if(event.key.keysym.sym == SDLK_F1) {
+                    Uint32 flags = SDL_GetWindowFlags(window);
+                    if(flags & SDL_WINDOW_FULLSCREEN_DESKTOP) {
+                        SDL_SetWindowFullscreen(window, 0);
+                    } else {
+                        SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
+                    }
+                }
+
+                // Next internal resolution; presenter_frame() picks it up
+                if(event.key.keysym.sym == SDLK_F2) {
+                    const Surface* frame = render_target(view);
+                    int next = 0;
+                    for(int r = 0; r < RESOLUTION_COUNT; r++) {
+                        if(resolutions[r].w == frame->width && resolutions[r].h == frame->height) {
+                            next = (r + 1) % RESOLUTION_COUNT;
+                        }
+                    }
+                    if(!render_set_resolution(view, resolutions[next].w, resolutions[next].h)) {
+                        SDL_Log("Out of memory, staying at %dx%d", frame->width, frame->height);
+                    }
+                }
+
+                // Zone times and counters over the frame, in PROFILE builds
+                if(event.key.keysym.sym == SDLK_F3) {
+                    profile_overlay = !profile_overlay;
+                    profile_set_overlay(profile_overlay);
+                }
+
+                if(event.key.keysym.sym == SDLK_LCTRL || event.key.keysym.sym == SDLK_RCTRL) {
+                    pending_input |= INPUT_FIRE;
+                }
+            }
+        }
+
+        // Run as many fixed ticks as real time has covered, then draw the
+        // camera and sprites part way towards the next one
+        Uint64 now = SDL_GetPerformanceCounter();
+        double frame_seconds = (double)(now - last_counter) / counter_frequency;
+        last_counter = now;
+        if(frame_seconds > MAX_FRAME_SECONDS) frame_seconds = MAX_FRAME_SECONDS;
+        accumulator += frame_seconds;
+
+        unsigned input = read_input(SDL_GetKeyboardState(NULL));
+        while(accumulator >= TICK_SECONDS && running) {
+            unsigned tick_input = input | pending_input;
+            if(play_file) {
+                if(tick == replay.tick_count) {
+                    running = 0;
+                    break;
+                }
+                tick_input = replay.inputs[tick];
+            } else if(recording && !replay_record(&replay, tick_input)) {
+                // What was recorded so far still plays back
+                SDL_Log("Out of memory, recording stopped");
+                recording = 0;
+            }
+            tick++;
+
+            previous_camera = world->camera;
+            world_tick(world, tick_input);
+            pending_input = 0;
+            accumulator -= TICK_SECONDS;
+        }
+
+        float alpha = (float)(accumulator / TICK_SECONDS);
+        render_set_camera(view, lerp_camera(previous_camera, world->camera, alpha));
+        render_set_interpolation(view, alpha);
+
+        // Returns once the frame is rendered, so the world can tick again
+        presenter_frame(presenter, world);
+        profile_frame_end();
+    }
+
+    presenter_destroy(presenter);
+    if(trace_file) profile_write_trace(trace_file);
+    if(record_file && !play_file && !replay_save(&replay, record_file)) SDL_Log("Failed to write %s!", record_file);
+    replay_free(&replay);
+    texture_free_all();
+    world_destroy(world);
+    render_view_destroy(view);
+    free_map(&map);
+    thread_pool_shutdown();
+
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
 }
\ No newline at end of file
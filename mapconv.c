@@ -0,0 +1,29 @@
+#include "include/map.h"
+#include <stdio.h>
+
+// Offline converter from the text .map format to the binary one that
+// load_map() can mmap directly. The tile distance field is computed here
+// so loading the result does no work at all.
+
+int main(int argc, char* argv[]) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s input.map output.rmap\n", argv[0]);
+        return 1;
+    }
+
+    Map map = {0};
+    if(!load_map(&map, argv[1])) {
+        fprintf(stderr, "Failed to load %s\n", argv[1]);
+        return 1;
+    }
+    if(!save_map_binary(&map, argv[2])) {
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+        free_map(&map);
+        return 1;
+    }
+
+    printf("%s: %dx%d cells, %dx%d tiles\n", argv[2], map.height, map.width,
+           map.grid.tiles_x, map.grid.tiles_y);
+    free_map(&map);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "include/graphic.h"
+#include "include/map.h"
+#include "include/render.h"
+#include "include/thread_pool.h"
+#include "include/world.h"
+#include "include/scheduler.h"
+#include "include/frame_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+// Headless session server: runs worlds for another process, which drives
+// them and reads their frames through shared memory (see frame_server.h).
+// Run it from the build directory so the map and textures resolve like
+// the game does.
+
+static Map map;
+static FrameServerHeader* serving = NULL;
+
+static void stop_serving(int signal) {
+    (void)signal;
+    if(serving) __atomic_store_n(&serving->shutdown, 1, __ATOMIC_RELEASE);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "usage: %s [-s name] [-n sessions] [-r WxH] [-q slots] [-f] [-t threads] [-m map] [-F distance] [-S seed]\n"
+        "  -s  shared memory name (default /raycast)\n"
+        "  -n  sessions, each its own world (default 1)\n"
+        "  -r  frame resolution (default 320x240)\n"
+        "  -q  frames buffered per session, 1 to %d (default 2)\n"
+        "  -f  free-running: tick at %d Hz instead of once per action\n"
+        "  -t  threads, 0 for one per CPU (default 0)\n"
+        "  -m  map file (default demo.map)\n"
+        "  -F  fog, side shading and ray culling, solid fog at this many cells\n"
+        "  -S  seed of session 0, session i gets seed + i (default %d)\n",
+        argv0, FRAME_SERVER_MAX_SLOTS, TICK_RATE, WORLD_DEFAULT_SEED);
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = "/raycast";
+    const char* map_file = "demo.map";
+    int sessions = 1, slots = 2, threads = 0;
+    int mode = FRAME_SERVER_LOCKSTEP;
+    int width = DEFAULT_SCREEN_WIDTH, height = DEFAULT_SCREEN_HEIGHT;
+    float fog_distance = 0.0f;
+    uint32_t seed = WORLD_DEFAULT_SEED;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            sessions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if(sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            slots = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-f") == 0) {
+            mode = FRAME_SERVER_FREE_RUNNING;
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if(strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            fog_distance = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(sessions < 1 || slots < 1 || slots > FRAME_SERVER_MAX_SLOTS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!load_map(&map, map_file)) {
+        fprintf(stderr, "Failed to load map!\n");
+        return 1;
+    }
+    if (texture_load("texture/wall.bmp") != TEX_WALL ||
+        texture_load("texture/entity.bmp") != TEX_ENTITY ||
+        texture_load("texture/weapon.bmp") != TEX_WEAPON ||
+        texture_load("texture/ammo.bmp") != TEX_AMMO) {
+        fprintf(stderr, "Failed to load textures!\n");
+        return 1;
+    }
+    texture_build_atlas();
+
+    Instance* instances = calloc(sessions, sizeof(Instance));
+    if(!instances) return 1;
+    for(int i = 0; i < sessions; i++) {
+        instances[i].world = world_create(&map);
+        instances[i].view = render_view_create(width, height);
+        if(!instances[i].world || !instances[i].view) {
+            fprintf(stderr, "Failed to create session %d!\n", i);
+            return 1;
+        }
+        // Sessions are reproducible from the seed and their inputs alone
+        world_seed(instances[i].world, seed + i);
+        world_spawn_entities(instances[i].world);
+        if(fog_distance > 0.0f) {
+            render_set_fog(instances[i].view, 0x000000, fog_distance * 0.25f, fog_distance);
+            render_set_fog_culling(instances[i].view, 1);
+            render_set_side_light(instances[i].view, 0.75f);
+        }
+    }
+
+    threads = thread_pool_init(threads);
+    FrameServer* server = frame_server_create(name, instances, sessions, slots, mode);
+    if(!server) return 1;
+    FrameServerHeader* header = frame_server_header(server);
+    printf("serving %d %s sessions of %ux%u frames on %s, %d threads\n", sessions,
+           mode == FRAME_SERVER_LOCKSTEP ? "lockstep" : "free-running",
+           header->width, header->height, name, threads);
+    fflush(stdout);
+
+    serving = header;
+    signal(SIGINT, stop_serving);
+    signal(SIGTERM, stop_serving);
+    frame_server_run(server);
+    serving = NULL;
+
+    frame_server_destroy(server);
+    for(int i = 0; i < sessions; i++) {
+        world_destroy(instances[i].world);
+        render_view_destroy(instances[i].view);
+    }
+    free(instances);
+    texture_free_all();
+    free_map(&map);
+    thread_pool_shutdown();
+    return 0;
+}